@@ -29,10 +29,9 @@
 
 #include "cas.h"
 
-#define CAS_QUEUE_LENGTH 4
-StaticQueue_t cas_queue_buf;
-QueueHandle_t cas_queue;
-uint8_t ucCASQueueStorage[CAS_QUEUE_LENGTH * PBUS_QUEUE_IS];
+StaticStreamBuffer_t cas_events_buf;
+StreamBufferHandle_t cas_events;
+uint8_t ucCASEventStorage[PBUS_EVENTS * PBUS_QUEUE_IS + 1];
 TaskHandle_t cas_task;
 
 
@@ -52,18 +51,23 @@ TaskHandle_t cas_task;
  ****************************************************************************/
 
 void cas_proc_task(void* unused_arg) {
-  uint32_t fifo_cmd;
+  uint32_t fifo_cmd[PBUS_EVENTS];
+  size_t n;
   uint8_t reg;
 
   while (1)
     {
-      // Process queue
-      if (xQueueReceive (cas_queue, &fifo_cmd, (TickType_t) 1))
+      // Process all pending events
+      n = xStreamBufferReceive (cas_events, fifo_cmd, sizeof (fifo_cmd),
+				(TickType_t) 1) / PBUS_QUEUE_IS;
+      if (n > 0)
+	bus_ring_kick ();
+      for (size_t i = 0; i < n; ++i)
 	{
-	  reg = (fifo_cmd >> 8) & 0xFF;
+	  reg = (fifo_cmd[i] >> 8) & 0xFF;
 	  if (reg == 0xCB)
 	    {
-	      xmod_buffer[xmod_len++] = (uint8_t) fifo_cmd & 0xFF;
+	      xmod_buffer[xmod_len++] = (uint8_t) fifo_cmd[i] & 0xFF;
 	      change_io_reg (0xCA, 0x2, 0x0);
 	    }
 	}
@@ -82,7 +86,7 @@ void cas_proc_task(void* unused_arg) {
  * Name: init_cas
  *
  * Description:
- *   Initializes the CAS interface. Setup of a queue to receive
+ *   Initializes the CAS interface. Setup of a stream buffer to receive
  *   events from the parallel bus and start of task to receive
  *   and send bytes from the xmodem buffer.
  *
@@ -96,12 +100,11 @@ void cas_proc_task(void* unused_arg) {
 
 void init_cas ()
 {
-    // Initialize queue and task for processing GDP commands
-  cas_queue = xQueueGenericCreateStatic(CAS_QUEUE_LENGTH,
-					PBUS_QUEUE_IS,
-					&(ucCASQueueStorage[0]),
-					&cas_queue_buf,
-					queueQUEUE_TYPE_BASE);
+    // Initialize stream buffer and task for processing CAS events
+  cas_events = xStreamBufferCreateStatic(PBUS_EVENTS * PBUS_QUEUE_IS,
+					 PBUS_QUEUE_IS,
+					 &(ucCASEventStorage[0]),
+					 &cas_events_buf);
 
   BaseType_t cas_status = xTaskCreate(cas_proc_task,
 				      "CAS_TASK",
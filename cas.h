@@ -28,14 +28,14 @@
 
 #include <FreeRTOS.h>
 #include <task.h>
-#include <queue.h>
+#include <stream_buffer.h>
 
 // IO handling in assembler
 extern void cas_getflag (void);
 extern void cas_setflag (void);
 
 // Cassette interface
-extern QueueHandle_t cas_queue;
+extern StreamBufferHandle_t cas_events;
 
 extern void init_cas ();
 
@@ -30,18 +30,40 @@
 #include "hardware/irq.h"
 #include "gdp.pio.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <queue.h>
+
 #include "par_bus.h"
 #include "gdp.h"
 #include "gdp_char.h"
 #include "gdp_line.h"
+#include "gdp_list.h"
+#include "gdp_dlist.h"
+#include "gdp_worker.h"
+#include "gdp_overlay.h"
 
 
 uint sm_gdp_sync = 2;
 uint sm_gdp_data = 3;
 uint sm_gdp_lut = 1;
 
+gdp_stats_t gdp_stats;
+
+// Speed of the drawing commands (GDP_SPEED_TURBO or GDP_SPEED_AUTHENTIC),
+// selected from the monitor
+uint8_t gdp_speed = GDP_SPEED_TURBO;
+
+// Approximate execution times of the EF9365 (cost model for the
+// authentic speed, see gdp_cmd_cost)
+#define GDP_T_CMD_US     2       // Decoding of any command
+#define GDP_T_PIXEL_US   1       // Step of a vector, cell of a character or block
+#define GDP_T_CLEAR_US   20000   // Clearing the page (one frame of the 50 Hz display)
+
+// Framebuffer lines ahead of the beam that are kept free (see gdp_beam_hold)
+#define GDP_BEAM_GUARD   4
+
 uint dma_channel_0;             // DMA channel for transferring sync data to PIO
 uint dma_channel_1;             // DMA channel for transferring pixel data data to PIO
 
@@ -257,7 +279,7 @@ uint32_t graphmem_4p[16384];
 uint32_t *graphmem;        // This points to the page that is shown
 uint32_t *graphmem_write;  // This points to the page where the drawing happens
 
-uint32_t line_count;
+volatile uint32_t line_count;   // Scanned line, updated by gdp_data_dma_handler
 // Pixels in line (Actually 512 pixels. However, x register must be loaded with 1 less for the first round
 uint32_t line_len = 511;
 
@@ -324,10 +346,9 @@ void calc_fulldlist (displist *dlist)
 }
 
 
-// Since the io register bank cannot be accessed from interrupt
-// handlers to avoid deadlocks from the used spinlock, a
-// separate variable is switched when the dma interrupt, indicating
-// a finished frame, is called.
+// Changes of the io register bank wait for core1. To keep the
+// interrupt handler short, a separate variable is switched when the
+// dma interrupt, indicating a finished frame, is called.
 uint8_t vsync_flag;
 
 
@@ -364,13 +385,87 @@ void __not_in_flash_func(gdp_sync_dma_handler) (void)
   dma_hw->ints0 = 1u << dma_channel_0;
 }
 
+// Pixel operation of the drawing primitives (GDP_PEN_xxx). It is
+// resolved once per command from control register 1 and the
+// extension control register instead of reading the registers
+// for every single pixel.
+uint8_t gdp_pen = GDP_PEN_NONE;
+
+/****************************************************************************
+ * Name: gdp_update_pen
+ *
+ * Description:
+ *   Determines the pixel operation for the following drawing commands.
+ *   CTRL1 bit 0 selects whether anything is drawn at all, bit 1 selects
+ *   pen (set) or eraser (clear). The extension bit GDPX_CTRL_XOR turns
+ *   the pen into a complement operation, i.e. drawing the same shape
+ *   twice restores the original picture.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_update_pen ()
+{
+  uint8_t ctrl1 = read_io_reg (gdp_ctrl1);
+
+  if ((ctrl1 & 0x1) == 0)
+    gdp_pen = GDP_PEN_NONE;
+  else if (read_io_reg (gdpx_ctrl) & GDPX_CTRL_XOR)
+    gdp_pen = GDP_PEN_XOR;
+  else if (ctrl1 & 0x2)
+    gdp_pen = GDP_PEN_SET;
+  else
+    gdp_pen = GDP_PEN_CLEAR;
+}
+
+// Clip rectangle of the drawing primitives (inclusive, screen coordinates).
+// Like the pixel operation, it is resolved once per command from the
+// extension registers (see gdp_update_clip).
+gdp_rect gdp_clip = {0, 0, 511, 255};
+
+/****************************************************************************
+ * Name: gdp_update_clip
+ *
+ * Description:
+ *   Loads the clip rectangle for the following drawing commands from
+ *   the extension registers and limits it to the screen. If the left
+ *   edge is right of the right edge (or the lower edge above the
+ *   upper edge), nothing is drawn at all.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_update_clip ()
+{
+  int x0 = read_io_reg (gdpx_clipx0h) * 256 + read_io_reg (gdpx_clipx0l),
+    x1 = read_io_reg (gdpx_clipx1h) * 256 + read_io_reg (gdpx_clipx1l),
+    y0 = read_io_reg (gdpx_clipy0),
+    y1 = read_io_reg (gdpx_clipy1);
+
+  gdp_clip.x0 = x0;
+  gdp_clip.x1 = (x1 > 511) ? 511 : x1;
+  gdp_clip.y0 = y0;
+  gdp_clip.y1 = y1;
+}
+
 /****************************************************************************
  * Name: plot_pixel
  *
  * Description:
- *   Draws/Erases a pixel in the active framebuffer. Whether a pixel
- *   is drawn at all and whether an erase or draw operation should
- *   carried out is determined from the GDP registers.
+ *   Draws/Erases/Complements a pixel in the active framebuffer according
+ *   to the current pixel operation (see gdp_update_pen). Pixels outside
+ *   the clip rectangle are ignored. The drawing primitives clip their
+ *   shapes beforehand and do not need this test for every pixel.
  *
  * Input Parameters:
  *   x      - x coordinate
@@ -383,21 +478,326 @@ void __not_in_flash_func(gdp_sync_dma_handler) (void)
 
 void plot_pixel (int x, int y)
 {
-  // Check if pixel is in (visible) screen
-  if ((x >= 0) && (x < 512) && (y >= 0) && (y < 256))
+  // Check if pixel is in the clip rectangle (which is on the screen)
+  if ((x >= gdp_clip.x0) && (x <= gdp_clip.x1) &&
+      (y >= gdp_clip.y0) && (y <= gdp_clip.y1))
     {
-      int mpos = ((255-(y & 0xFF)) * 16 + (x >> 5)) & (4096 - 1);
-      int bpos = 31 - (x & 0x1F);
-      uint8_t ctrl1 = read_io_reg (gdp_ctrl1);
-
-      // Check control register 1
-      if ((ctrl1 & 0x3) == 0x3)
-	graphmem_write[mpos] = graphmem_write[mpos] | 1u << bpos;
-      if ((ctrl1 & 0x3) == 0x1)
-	graphmem_write[mpos] = graphmem_write[mpos] & ~(1u << bpos);
+      int mpos = (255 - y) * 16 + (x >> 5);
+      uint32_t mask = 1u << (31 - (x & 0x1F));
+
+      switch (gdp_pen)
+	{
+	case GDP_PEN_SET:
+	  graphmem_write[mpos] |= mask;
+	  break;
+	case GDP_PEN_CLEAR:
+	  graphmem_write[mpos] &= ~mask;
+	  break;
+	case GDP_PEN_XOR:
+	  graphmem_write[mpos] ^= mask;
+	  break;
+	}
     }
 }
 
+// Background fill of whole framebuffer words by DMA (see gdp_fill_start)
+uint dma_fill_channel;
+static uint32_t gdp_fill_word;
+
+/****************************************************************************
+ * Name: gdp_fill_start
+ *
+ * Description:
+ *   Starts filling consecutive framebuffer words with a constant value
+ *   by DMA and returns without waiting. A previous fill is completed
+ *   first. The DMA can only store whole words (it cannot combine
+ *   pixels with the framebuffer), so it is used for clearing the page
+ *   and for rectangles that span the full width. Before touching the
+ *   framebuffer, the drawing code must call gdp_fill_wait.
+ *
+ * Input Parameters:
+ *   dst    - First word
+ *   value  - Value to store
+ *   words  - Number of words
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_fill_start (uint32_t *dst, uint32_t value, unsigned int words)
+{
+  gdp_fill_wait ();
+  gdp_fill_word = value;
+  dma_channel_set_read_addr (dma_fill_channel, &gdp_fill_word, false);
+  dma_channel_set_write_addr (dma_fill_channel, dst, false);
+  dma_channel_set_trans_count (dma_fill_channel, words, true);
+}
+
+/****************************************************************************
+ * Name: gdp_fill_busy
+ *
+ * Description:
+ *   Checks whether a background fill (DMA or core1) is still running.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   true while the DMA is filling
+ *
+ ****************************************************************************/
+
+bool gdp_fill_busy ()
+{
+  return (dma_channel_is_busy (dma_fill_channel) || gdp_worker_busy ());
+}
+
+/****************************************************************************
+ * Name: gdp_fill_wait
+ *
+ * Description:
+ *   Waits until the background fill (DMA or core1) is complete. Other
+ *   tasks of the same priority may run in the meantime.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_fill_wait ()
+{
+  while (gdp_fill_busy ())
+    taskYIELD ();
+}
+
+/****************************************************************************
+ * Name: gdp_init_fill
+ *
+ * Description:
+ *   Sets up the DMA channel for the background fill. The channel copies
+ *   one source word to incrementing addresses without pacing.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_init_fill ()
+{
+  dma_fill_channel = dma_claim_unused_channel(true);
+
+  dma_channel_config c = dma_channel_get_default_config(dma_fill_channel);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, false);
+  channel_config_set_write_increment(&c, true);
+  channel_config_set_dreq(&c, 0x3F);  // Unpaced transfer
+
+  dma_channel_configure(dma_fill_channel, &c,
+			graphmem_4p,       // Destination pointer (set per fill)
+			&gdp_fill_word,    // Source pointer
+			0,                 // Number of transfers (set per fill)
+			false);            // Do not start
+}
+
+/****************************************************************************
+ * Name: fill_span
+ *
+ * Description:
+ *   Draws/Erases/Complements a horizontal run of pixels in the active
+ *   framebuffer. Instead of going pixel by pixel, the run is split into
+ *   a partial first word, a number of full words and a partial last word.
+ *   The operation is the same as in plot_pixel. Parts of the run outside
+ *   the clip rectangle are cut off.
+ *
+ * Input Parameters:
+ *   x0     - x coordinate of first pixel
+ *   x1     - x coordinate of last pixel (inclusive)
+ *   y      - y coordinate
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void fill_span (int x0, int x1, int y)
+{
+  // Cut off everything that is outside the clip rectangle
+  if ((y < gdp_clip.y0) || (y > gdp_clip.y1))
+    return;
+  if (x0 < gdp_clip.x0)
+    x0 = gdp_clip.x0;
+  if (x1 > gdp_clip.x1)
+    x1 = gdp_clip.x1;
+  if (x0 > x1)
+    return;
+
+  uint32_t *row = &graphmem_write[(255 - y) * 16];
+  int w0 = x0 >> 5,
+    w1 = x1 >> 5;
+  // Leftmost pixel is in bit 31 of each word
+  uint32_t m0 = 0xFFFFFFFFu >> (x0 & 0x1F),
+    m1 = 0xFFFFFFFFu << (31 - (x1 & 0x1F));
+
+  if (w0 == w1)
+    {
+      m0 &= m1;
+      m1 = m0;
+    }
+
+  switch (gdp_pen)
+    {
+    case GDP_PEN_SET:
+      row[w0] |= m0;
+      for (int w = w0 + 1; w < w1; ++w)
+	row[w] = 0xFFFFFFFFu;
+      row[w1] |= m1;
+      break;
+    case GDP_PEN_CLEAR:
+      row[w0] &= ~m0;
+      for (int w = w0 + 1; w < w1; ++w)
+	row[w] = 0;
+      row[w1] &= ~m1;
+      break;
+    case GDP_PEN_XOR:
+      // Note: For w0 == w1 the word must only be touched once
+      row[w0] ^= m0;
+      for (int w = w0 + 1; w < w1; ++w)
+	row[w] = ~row[w];
+      if (w1 != w0)
+	row[w1] ^= m1;
+      break;
+    }
+}
+
+/****************************************************************************
+ * Name: blit_row
+ *
+ * Description:
+ *   Applies a horizontal bit pattern to one line of the active framebuffer
+ *   with the current pixel operation. Set bits in the pattern are drawn,
+ *   cleared bits leave the framebuffer untouched. The pattern is shifted
+ *   into position and combined with the framebuffer a whole word at a time.
+ *   Parts outside the clip rectangle are cut off.
+ *
+ * Input Parameters:
+ *   pat    - Pattern, bit 31 of the first word is the leftmost pixel.
+ *            Bits beyond the length must be zero.
+ *   n      - Length of the pattern in pixels
+ *   x      - x coordinate of the leftmost pixel
+ *   y      - y coordinate
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void blit_row (const uint32_t *pat, int n, int x, int y)
+{
+  if ((y < gdp_clip.y0) || (y > gdp_clip.y1) || (n <= 0) ||
+      (x > gdp_clip.x1) || (x + n <= gdp_clip.x0))
+    return;
+
+  uint32_t *row = &graphmem_write[(255 - y) * 16];
+  int sh = x & 0x1F,
+    w = x >> 5,        // Note: Rounds towards -infinity for negative x
+    npw = (n + 31) >> 5,
+    cw0 = gdp_clip.x0 >> 5,
+    cw1 = gdp_clip.x1 >> 5;
+
+  // Only the pattern words that hit the clip rectangle
+  int i0 = (cw0 > w) ? cw0 - w : 0,
+    i1 = (cw1 - w < npw) ? cw1 - w : npw;
+
+  for (int i = i0; i <= i1; ++i)
+    {
+      int tw = w + i;
+      uint32_t m = (i < npw) ? (pat[i] >> sh) : 0;
+      if ((i > 0) && (sh != 0))
+	m |= pat[i - 1] << (32 - sh);
+      if (tw == cw0)
+	m &= 0xFFFFFFFFu >> (gdp_clip.x0 & 0x1F);
+      if (tw == cw1)
+	m &= 0xFFFFFFFFu << (31 - (gdp_clip.x1 & 0x1F));
+      if (m == 0)
+	continue;
+
+      switch (gdp_pen)
+	{
+	case GDP_PEN_SET:
+	  row[tw] |= m;
+	  break;
+	case GDP_PEN_CLEAR:
+	  row[tw] &= ~m;
+	  break;
+	case GDP_PEN_XOR:
+	  row[tw] ^= m;
+	  break;
+	}
+    }
+}
+
+/****************************************************************************
+ * Name: fill_rect
+ *
+ * Description:
+ *   Draws/Erases a solid rectangle in the active framebuffer by
+ *   filling one horizontal run per line. Rectangles that cover whole
+ *   lines are set or cleared in the background (see gdp_fill_start).
+ *   When the core1 worker is enabled, the other rectangles are queued
+ *   for core1 line by line (see gdp_worker.c).
+ *
+ * Input Parameters:
+ *   x0     - x coordinate of left edge
+ *   y0     - y coordinate of lower edge
+ *   x1     - x coordinate of right edge (inclusive)
+ *   y1     - y coordinate of upper edge (inclusive)
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void fill_rect (int x0, int y0, int x1, int y1)
+{
+  if (y0 < gdp_clip.y0)
+    y0 = gdp_clip.y0;
+  if (y1 > gdp_clip.y1)
+    y1 = gdp_clip.y1;
+  if (y0 > y1)
+    return;
+
+  // Whole lines are consecutive words (the upper line first)
+  if ((x0 <= 0) && (x1 >= 511) && (gdp_clip.x0 == 0) && (gdp_clip.x1 == 511) &&
+      ((gdp_pen == GDP_PEN_SET) || (gdp_pen == GDP_PEN_CLEAR)))
+    {
+      gdp_fill_start (&graphmem_write[(255 - y1) * 16],
+		      (gdp_pen == GDP_PEN_SET) ? 0xFFFFFFFFu : 0,
+		      (y1 - y0 + 1) * 16);
+      return;
+    }
+
+  if (gdp_worker_enabled)
+    {
+      // Core1 fills the spans in order, only the DMA must be done
+      while (dma_channel_is_busy (dma_fill_channel))
+	taskYIELD ();
+      for (int y = y1; y >= y0; --y)
+	gdp_worker_span (x0, x1, y);
+      return;
+    }
+
+  gdp_fill_wait ();
+  for (int y = y0; y <= y1; ++y)
+    fill_span (x0, x1, y);
+}
+
 /****************************************************************************
  * Name: gdp_proc_command
  *
@@ -405,6 +805,10 @@ void plot_pixel (int x, int y)
  *   The EF9365 graphics commands are initiated by a write to the
  *   command registers. This functions receives such a command
  *   value and carries the respective function out.
+ *   Note: Commands 0x0 - 0x3 and 0x5 only change registers. When
+ *   written to the command register, they are already executed on
+ *   core1 (gdp_sendcmd) and do not arrive here. They are still
+ *   handled for the command list.
  *
  * Input Parameters:
  *   gdp_cmd   - Command as described in the datasheet for the EF9365
@@ -423,6 +827,11 @@ void gdp_proc_command (unsigned char gdp_cmd)
   printf ("G %02x  X%04x   Y%04x  CT1%02x\n", gdp_cmd, x_ref, y_ref, ctrl1);
   */
 
+  // Pixel operation and clip rectangle are fixed for the duration of the command
+  gdp_update_pen ();
+  gdp_update_clip ();
+  gdp_fill_wait ();
+
   if (gdp_cmd < 0x10)
     {
       switch (gdp_cmd)
@@ -444,7 +853,7 @@ void gdp_proc_command (unsigned char gdp_cmd)
 	  change_io_reg (gdp_ctrl1, 0, 0x1);
 	  break;
 	case 0x7:
-	  write_io_reg (gdp_ctrl1, 0);
+	  post_io_reg (gdp_ctrl1, 0);
 	  write_io_reg (gdp_ctrl2, 0);
 	  write_io_reg (gdp_csize, 0x11);
 	case 0x6:
@@ -453,7 +862,7 @@ void gdp_proc_command (unsigned char gdp_cmd)
 	  write_io_reg (gdp_ymsb, 0);
 	  write_io_reg (gdp_ylsb, 0);
 	case 0x4:
-	  memset (graphmem_write, 0, 16384);
+	  gdp_fill_start (graphmem_write, 0, 4096);
 	  break;
 	case 0x5:
 	  write_io_reg (gdp_xmsb, 0);
@@ -462,7 +871,7 @@ void gdp_proc_command (unsigned char gdp_cmd)
 	  write_io_reg (gdp_ylsb, 0);
 	  break;
 	case 0xA:
-	  draw_char (128u); // 0x20 + 96
+	  draw_block ();
 	  break;
 	}
     }
@@ -671,7 +1080,10 @@ void __not_in_flash_func(gdp_data_dma_handler)(void)
       uint32_t *src, *dst;
       PIO pio = pio1;
 
-      src = &graphmem[(((line_count >> 2) + 1) & 0xFF) << 4];
+      unsigned int row = ((line_count >> 2) + 1) & 0xFF;
+      src = &graphmem[row << 4];
+      if (ovl_visible && (row >= OVL_TOP))
+	src = &ovl_bitmap[(row - OVL_TOP) << 4];   // On-screen monitor
       if (line_count & 0x4)
 	dst = line_buf1;
       else
@@ -701,20 +1113,458 @@ void __not_in_flash_func(gdp_data_dma_handler)(void)
 }
 
 
-// Queue and task for receiving gdp commands
-#define GDP_QUEUE_LENGTH 4
-StaticQueue_t gdp_queue_buf;
-QueueHandle_t gdp_queue;
-uint8_t ucGDPQueueStorage[GDP_QUEUE_LENGTH * PBUS_QUEUE_IS];
+/****************************************************************************
+ * Name: gdp_cmd_cost
+ *
+ * Description:
+ *   Estimates the time the EF9365 needs for a command, based on the
+ *   current register values: Vectors take one pixel time per step along
+ *   the longer projection, characters and blocks one pixel time per
+ *   cell of the (scaled) character matrix. Clearing the page takes
+ *   about one frame. Must be called before the command is executed.
+ *
+ * Input Parameters:
+ *   gdp_cmd   - Command as described in the datasheet for the EF9365
+ *
+ * Returned Value:
+ *   Execution time in us
+ *
+ ****************************************************************************/
+
+uint32_t gdp_cmd_cost (unsigned char gdp_cmd)
+{
+  uint8_t siz = read_io_reg (gdp_csize);
+  unsigned int size_x = (siz >> 4) ? (siz >> 4) : 16,
+    size_y = (siz & 0xF) ? (siz & 0xF) : 16;
+  unsigned int w = 5,
+    h = 8;
+  int dx, dy;
+
+  if ((gdp_cmd >= 0x20) && (gdp_cmd < 0x80))
+    {
+      // Characters from the font RAM have their own cell size
+      if (read_io_reg (gdpx_ctrl) & GDPX_CTRL_FONT)
+	{
+	  uint8_t fcfg = read_io_reg (gdpx_fcfg);
+	  w = (fcfg & 0xF) + 1;
+	  h = (fcfg & 0x10) ? 16 : 8;
+	}
+      return (GDP_T_CMD_US + GDP_T_PIXEL_US * w * size_x * h * size_y);
+    }
+
+  if (gdp_cmd >= 0x10)
+    {
+      line_projections (gdp_cmd, &dx, &dy);
+      dx = abs (dx);
+      dy = abs (dy);
+      return (GDP_T_CMD_US + GDP_T_PIXEL_US * ((dx > dy) ? dx : dy));
+    }
+
+  switch (gdp_cmd)
+    {
+    case 0x4:
+    case 0x6:
+    case 0x7:
+      return (GDP_T_CMD_US + GDP_T_CLEAR_US);
+    case 0xA:
+      return (GDP_T_CMD_US + GDP_T_PIXEL_US * w * size_x * h * size_y);
+    }
+
+  return (GDP_T_CMD_US);
+}
+
+/****************************************************************************
+ * Name: gdp_cmd_rows
+ *
+ * Description:
+ *   Determines the lines a command will draw on, based on the current
+ *   register values (without clipping). Must be called before the
+ *   command is executed.
+ *
+ * Input Parameters:
+ *   gdp_cmd   - Command as described in the datasheet for the EF9365
+ *   y0        - Lowest line, returned
+ *   y1        - Highest line, returned (y1 < y0 if nothing is drawn)
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_cmd_rows (unsigned char gdp_cmd, int *y0, int *y1)
+{
+  int x = read_io_reg(gdp_xmsb) * 256 + read_io_reg(gdp_xlsb),
+    y = read_io_reg(gdp_ymsb) * 256 + read_io_reg(gdp_ylsb);
+  int dx, dy;
+
+  *y0 = 1;
+  *y1 = 0;
+
+  if (gdp_cmd >= 0x80 || ((gdp_cmd >= 0x10) && (gdp_cmd < 0x20)))
+    {
+      line_projections (gdp_cmd, &dx, &dy);
+      *y0 = (dy < 0) ? y + dy : y;
+      *y1 = (dy < 0) ? y : y + dy;
+    }
+  else if (gdp_cmd >= 0x20)
+    {
+      gdp_text_attr attr;
+      gdp_rect box;
+      uint8_t a = gdp_cmd;
+
+      get_text_attr (&attr);
+      text_box (&a, 1, &attr, x, y, &box);
+      *y0 = box.y0;
+      *y1 = box.y1;
+    }
+  else if (gdp_cmd == 0xA)
+    {
+      // Block, any orientation
+      uint8_t siz = read_io_reg (gdp_csize);
+      int w = 5 * ((siz >> 4) ? (siz >> 4) : 16),
+	h = 8 * ((siz & 0xF) ? (siz & 0xF) : 16);
+      *y0 = y - w - h;
+      *y1 = y + w + h;
+    }
+  else if ((gdp_cmd == 0x4) || (gdp_cmd == 0x6) || (gdp_cmd == 0x7))
+    {
+      *y0 = 0;
+      *y1 = 255;
+    }
+}
+
+/****************************************************************************
+ * Name: gdp_beam_hold
+ *
+ * Description:
+ *   When the Z80 draws on the page that is shown and has selected
+ *   GDPX_CTRL_SYNC, waits until drawing on the given lines cannot be
+ *   seen half done: The lines must not be scanned right now and the
+ *   beam must not reach them within the next GDP_BEAM_GUARD lines of
+ *   the framebuffer. During the vertical blank, everything may be
+ *   drawn. The beam position is taken from line_count (each line of
+ *   the framebuffer is shown 4 times, 0 during the vertical blank).
+ *
+ * Input Parameters:
+ *   y0     - Lowest line that will be drawn on
+ *   y1     - Highest line that will be drawn on
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_beam_hold (int y0, int y1)
+{
+  if ((graphmem_write != graphmem) ||
+      ((read_io_reg (gdpx_ctrl) & GDPX_CTRL_SYNC) == 0))
+    return;
+
+  if (y0 < 0)
+    y0 = 0;
+  if (y1 > 255)
+    y1 = 255;
+  if (y0 > y1)
+    return;
+
+  // Lines are stored (and scanned) from the top
+  int r0 = 255 - y1,
+    r1 = 255 - y0;
+  uint32_t t_start = time_us_32 ();
+  int held = 0;
+
+  while (1)
+    {
+      uint32_t lc = line_count;
+      int beam = (lc == 0) ? 256 : (int) (lc >> 2);
+      if ((beam < r0 - GDP_BEAM_GUARD) || (beam > r1))
+	break;
+      held = 1;
+      taskYIELD ();
+    }
+
+  if (held)
+    {
+      ++gdp_stats.held;
+      gdp_stats.held_us += time_us_32 () - t_start;
+    }
+}
+
+/****************************************************************************
+ * Name: gdp_exec_command
+ *
+ * Description:
+ *   Executes a command written to the command register and updates the
+ *   statistics. On the shown page, the command may have to wait for
+ *   the beam first (see gdp_beam_hold). The lines it draws on are
+ *   only determined in that case. At authentic speed, the command is
+ *   only completed when the time given by the cost model has passed
+ *   since its start, i.e. the Z80 sees the GDP busy for the same time
+ *   as with the EF9365. Longer waits give the other tasks the
+ *   processor, the rest is waited actively. The GDP ready flag is not
+ *   set here.
+ *
+ * Input Parameters:
+ *   gdp_cmd   - Command as described in the datasheet for the EF9365
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_exec_command (unsigned char gdp_cmd)
+{
+  if ((graphmem_write == graphmem) &&
+      (read_io_reg (gdpx_ctrl) & GDPX_CTRL_SYNC))
+    {
+      int y0, y1;
+
+      gdp_cmd_rows (gdp_cmd, &y0, &y1);
+      gdp_beam_hold (y0, y1);
+    }
+
+  uint32_t t_start = time_us_32 ();
+  uint32_t cost = gdp_cmd_cost (gdp_cmd);
+
+  gdp_proc_command (gdp_cmd);
+  gdp_stats.busy_us += time_us_32 () - t_start;
+  gdp_stats.model_us += cost;
+  ++gdp_stats.commands;
+
+  if (gdp_speed == GDP_SPEED_AUTHENTIC)
+    {
+      int32_t t_left = (int32_t) (t_start + cost - time_us_32 ());
+      if (t_left > 2000 * portTICK_PERIOD_MS)
+	vTaskDelay ((t_left / 1000 - portTICK_PERIOD_MS) / portTICK_PERIOD_MS);
+      while ((int32_t) (t_start + cost - time_us_32 ()) > 0)
+	tight_loop_contents ();
+    }
+}
+
+// Registers lent to tests and measurements (see gdp_regs_lend)
+static const uint8_t lend_regs[GDP_LEND_REGS] = {
+  gdp_ctrl1, gdp_ctrl2, gdp_csize, gdp_deltax, gdp_deltay,
+  gdp_xmsb, gdp_xlsb, gdp_ymsb, gdp_ylsb, gdpx_ctrl};
+
+/****************************************************************************
+ * Name: gdp_regs_lend
+ *
+ * Description:
+ *   Prepares the registers for a test or measurement in the GDP task
+ *   (see gdp_call) that sets its own position, sizes and modes. The
+ *   GDP reports busy until gdp_regs_return, like for a long command,
+ *   so the Z80 does not start commands in between. The values of the
+ *   Z80 are saved.
+ *
+ * Input Parameters:
+ *   save   - Saved register values, filled
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_regs_lend (gdp_regs_save_t *save)
+{
+  save->ready = read_io_reg (gdp_status) & 0x4;
+  change_io_reg (gdp_status, 0, 0x4);
+  for (unsigned int r = 0; r < GDP_LEND_REGS; ++r)
+    save->z80[r] = read_io_reg (lend_regs[r]);
+  gdp_regs_note (save);
+}
+
+/****************************************************************************
+ * Name: gdp_regs_note
+ *
+ * Description:
+ *   Records the current register values as set by the GDP task. Must
+ *   be called after each change of the lent registers (including the
+ *   position changed by drawing), so gdp_regs_return can tell them
+ *   from writes of the Z80.
+ *
+ * Input Parameters:
+ *   save   - Saved register values, updated
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_regs_note (gdp_regs_save_t *save)
+{
+  for (unsigned int r = 0; r < GDP_LEND_REGS; ++r)
+    save->own[r] = read_io_reg (lend_regs[r]);
+}
+
+/****************************************************************************
+ * Name: gdp_regs_return
+ *
+ * Description:
+ *   Ends a test or measurement started with gdp_regs_lend. Registers
+ *   that still hold the value last set by the GDP task get the value
+ *   of the Z80 back. A register the Z80 has written in the meantime
+ *   keeps the new value. The GDP is ready again if it was before.
+ *
+ * Input Parameters:
+ *   save   - Saved register values
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_regs_return (gdp_regs_save_t *save)
+{
+  for (unsigned int r = 0; r < GDP_LEND_REGS; ++r)
+    if (read_io_reg (lend_regs[r]) == save->own[r])
+      post_io_reg (lend_regs[r], save->z80[r]);
+  if (save->ready)
+    change_io_reg (gdp_status, 0x4, 0);
+}
+
+// Result of the reference trace (see gdp_time_trace)
+typedef struct gdp_trace_s {
+  uint32_t t_us;       // Measured duration
+  uint32_t model_us;   // Duration according to the cost model
+} gdp_trace_t;
+
+/****************************************************************************
+ * Name: time_trace
+ *
+ * Description:
+ *   Executes a fixed reference trace of vectors, characters and blocks
+ *   with the current speed and measures its duration. Each command is
+ *   executed twice at the same position in XOR mode, so the picture is
+ *   unchanged afterwards. Runs in the GDP task (see gdp_time_trace),
+ *   the registers are lent by the Z80 (see gdp_regs_lend).
+ *
+ * Input Parameters:
+ *   arg    - Result (gdp_trace_t), returned
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void time_trace (void *arg)
+{
+  const uint8_t trace[][4] = {   // Command, DELTAX, DELTAY, CSIZE
+    {0x11, 200, 50, 0x11}, {0x17, 100, 100, 0x11}, {0x13, 255, 0, 0x11},
+    {0x15, 3, 180, 0x11}, {0x19, 80, 20, 0x11}, {0xA1, 0, 0, 0x11},
+    {0xF7, 0, 0, 0x11}, {'A', 0, 0, 0x11}, {'g', 0, 0, 0x11},
+    {'#', 0, 0, 0x22}, {'W', 0, 0, 0x44}, {0x0A, 0, 0, 0x11},
+    {0x0A, 0, 0, 0x33}};
+  gdp_trace_t *res = (gdp_trace_t *) arg;
+  gdp_regs_save_t save;
+  gdp_stats_t save_stats = gdp_stats;
+  uint32_t t_start;
+
+  gdp_regs_lend (&save);
+  post_io_reg (gdp_ctrl1, 0x3);
+  write_io_reg (gdp_ctrl2, 0);
+  write_io_reg (gdpx_ctrl, GDPX_CTRL_XOR);
+  gdp_stats.model_us = 0;
+
+  t_start = time_us_32 ();
+  for (unsigned int rep = 0; rep < 8; ++rep)
+    for (unsigned int i = 0; i < sizeof (trace) / sizeof (trace[0]); ++i)
+      for (unsigned int k = 0; k < 2; ++k)
+	{
+	  write_io_reg (gdp_deltax, trace[i][1]);
+	  write_io_reg (gdp_deltay, trace[i][2]);
+	  write_io_reg (gdp_csize, trace[i][3]);
+	  write_io_reg (gdp_xmsb, 0);
+	  write_io_reg (gdp_xlsb, 100 + 16 * i);
+	  write_io_reg (gdp_ymsb, 0);
+	  write_io_reg (gdp_ylsb, 40);
+	  gdp_exec_command (trace[i][0]);
+	  gdp_regs_note (&save);
+	}
+  gdp_fill_wait ();
+  res->t_us = time_us_32 () - t_start;
+  res->model_us = gdp_stats.model_us;
+
+  gdp_stats = save_stats;
+  gdp_regs_return (&save);
+}
+
+/****************************************************************************
+ * Name: gdp_time_trace
+ *
+ * Description:
+ *   Runs the reference trace (see time_trace) in the GDP task between
+ *   two commands. While it runs, the GDP reports busy.
+ *
+ * Input Parameters:
+ *   model_us - Duration according to the cost model, returned
+ *
+ * Returned Value:
+ *   Measured duration in us
+ *
+ ****************************************************************************/
+
+uint32_t gdp_time_trace (uint32_t *model_us)
+{
+  gdp_trace_t res;
+
+  gdp_call (time_trace, &res);
+  *model_us = res.model_us;
+  return (res.t_us);
+}
+
+// Stream buffer and task for receiving gdp commands
+StaticStreamBuffer_t gdp_events_buf;
+StreamBufferHandle_t gdp_events;
+uint8_t ucGDPEventStorage[PBUS_EVENTS * PBUS_QUEUE_IS + 1];
 TaskHandle_t gdp_task;
 
+// Request of another task to run a function in the GDP task
+typedef struct gdp_call_s {
+  void (*fn) (void *arg);
+  void *arg;
+  TaskHandle_t caller;   // Notified when fn has returned
+} gdp_call_t;
+
+static QueueHandle_t gdp_calls;
+
+/****************************************************************************
+ * Name: gdp_call
+ *
+ * Description:
+ *   Runs a function in the GDP task between two commands and waits
+ *   until it has returned. Used by tests and measurements of the
+ *   monitor, which change the pen, the clip rectangle and the
+ *   registers used by the drawing commands.
+ *
+ * Input Parameters:
+ *   fn     - Function to run
+ *   arg    - Argument of fn
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_call (void (*fn) (void *arg), void *arg)
+{
+  gdp_call_t call = {fn, arg, xTaskGetCurrentTaskHandle ()};
+  gdp_call_t *p = &call;
+
+  xQueueSend (gdp_calls, &p, portMAX_DELAY);
+  ulTaskNotifyTake (pdTRUE, portMAX_DELAY);
+}
+
 /****************************************************************************
  * Name: gdp_proc_monitor
  *
  * Description:
  *   FreeRTOS task to listen for commands from the parallel bus.
  *   Picks the request up, executes the command and then sets the
- *   GDP ready flag.
+ *   GDP ready flag (when a background fill is complete and at authentic
+ *   speed only after the time the EF9365 would need, see
+ *   gdp_exec_command). Afterwards the command list is
+ *   executed at full speed (see gdp_list.c) and requests of other
+ *   tasks are run (see gdp_call).
  *
  * Input Parameters:
  *   unused_arg   - Not used.
@@ -725,27 +1575,47 @@ TaskHandle_t gdp_task;
  ****************************************************************************/
 
 void gdp_proc_monitor(void* unused_arg) {
-  uint32_t fifo_cmd;
+  uint32_t fifo_cmd[PBUS_EVENTS];
+  size_t n;
   uint8_t reg, data;
+  uint32_t t_start;
+  gdp_call_t *call;
 
   while (1)
     {
-      if (xQueueReceive (gdp_queue, &fifo_cmd, (TickType_t) 10))
+      n = xStreamBufferReceive (gdp_events, fifo_cmd, sizeof (fifo_cmd),
+				(TickType_t) 10) / PBUS_QUEUE_IS;
+      if (n > 0)
+	bus_ring_kick ();
+      for (size_t i = 0; i < n; ++i)
 	{
-	  reg = (fifo_cmd >> 8) & 0xFF;
+	  reg = (fifo_cmd[i] >> 8) & 0xFF;
 	  if (reg == 0x70)
 	    {
-	      gdp_proc_command (fifo_cmd & 0xFF);
+	      gdp_exec_command (fifo_cmd[i] & 0xFF);
+	      gdp_fill_wait ();
 	      change_io_reg (0x70, 0x4, 0); // For the GDP high indicates "not busy"
 	    }
 	}
+
+      // Signal from the list port (or timeout). Execute the command list.
+      t_start = time_us_32 ();
+      gdp_run_list ();
+      gdp_stats.busy_us += time_us_32 () - t_start;
+
+      // Requests of other tasks (see gdp_call)
+      while (xQueueReceive (gdp_calls, &call, 0) == pdTRUE)
+	{
+	  call->fn (call->arg);
+	  xTaskNotifyGive (call->caller);
+	}
     }
 }
 
 
-StaticQueue_t gdp_page_queue_buf;
-QueueHandle_t gdp_page_queue;
-uint8_t ucGDPPageQueueStorage[GDP_QUEUE_LENGTH * PBUS_QUEUE_IS];
+StaticStreamBuffer_t gdp_page_events_buf;
+StreamBufferHandle_t gdp_page_events;
+uint8_t ucGDPPageEventStorage[PBUS_EVENTS * PBUS_QUEUE_IS + 1];
 TaskHandle_t gdp_page_task;
 
 /****************************************************************************
@@ -753,7 +1623,7 @@ TaskHandle_t gdp_page_task;
  *
  * Description:
  *   Task to monitor changes to the page register as communicated
- *   from the parallel bus through the respective queue.
+ *   from the parallel bus through the respective stream buffer.
  *   Furthermore this task updates the Z80 IO register according
  *   to the vsync_flag.
  *
@@ -766,19 +1636,24 @@ TaskHandle_t gdp_page_task;
  ****************************************************************************/
 
 void gdp_page_monitor(void* unused_arg) {
-  uint32_t fifo_cmd;
+  uint32_t fifo_cmd[PBUS_EVENTS];
+  size_t n;
   uint8_t reg, data;
   uint8_t old_vsync = vsync_flag;
 
   while (1)
     {
       // Core function
-      if (xQueueReceive (gdp_page_queue, &fifo_cmd, (TickType_t) 1))
+      n = xStreamBufferReceive (gdp_page_events, fifo_cmd, sizeof (fifo_cmd),
+				(TickType_t) 1) / PBUS_QUEUE_IS;
+      if (n > 0)
+	bus_ring_kick ();
+      for (size_t i = 0; i < n; ++i)
 	{
-	  reg = (fifo_cmd >> 8) & 0xFF;
+	  reg = (fifo_cmd[i] >> 8) & 0xFF;
 	  if (reg == 0x60)
 	    {
-	      data = fifo_cmd & 0xFF;
+	      data = fifo_cmd[i] & 0xFF;
 	      gdp_set_pages ((data >> 4) & 0x3, (data >> 6) & 0x3);
 	    }
 	}
@@ -821,6 +1696,9 @@ int init_gdp ()
   graphmem = (uint32_t *)&graphmem_4p;
   graphmem_write = graphmem;
 
+  // Preload font RAM with the built-in character set
+  init_font ();
+
   /*
    * TODO: Actually, the code should also work with pio0! However, it
    * does not, which points to an error in some other part of the code#
@@ -833,6 +1711,7 @@ int init_gdp ()
 
   dma_channel_0 = dma_claim_unused_channel(true);	// Claim a DMA channel for the sync
   dma_channel_1 = dma_claim_unused_channel(true);	// Data channel
+  gdp_init_fill ();
 
   // Initial test step for DMA
   calc_fulldlist (hd_standard);
@@ -896,12 +1775,15 @@ int init_gdp ()
   dma_channel_start (dma_channel_0);
   dma_channel_start (dma_channel_1);
 
-  // Initialize queue and task for processing GDP commands
-  gdp_queue = xQueueGenericCreateStatic(GDP_QUEUE_LENGTH,
-					PBUS_QUEUE_IS,
-					&(ucGDPQueueStorage[0]),
-					&gdp_queue_buf,
-					queueQUEUE_TYPE_BASE);
+  // Initialize stream buffer and task for processing GDP commands
+  init_gdp_list ();
+  init_dlist ();
+  gdp_events = xStreamBufferCreateStatic(PBUS_EVENTS * PBUS_QUEUE_IS,
+					 PBUS_QUEUE_IS,
+					 &(ucGDPEventStorage[0]),
+					 &gdp_events_buf);
+
+  gdp_calls = xQueueCreate (1, sizeof (gdp_call_t *));
 
   BaseType_t monitor_status = xTaskCreate(gdp_proc_monitor,
 					  "GDP_TASK",
@@ -910,12 +1792,11 @@ int init_gdp ()
 					  1,
 					  &gdp_task);
 
-  // Initialize queue to manage page switches
-  gdp_page_queue = xQueueGenericCreateStatic(GDP_QUEUE_LENGTH,
-					PBUS_QUEUE_IS,
-					&(ucGDPPageQueueStorage[0]),
-					&gdp_page_queue_buf,
-					queueQUEUE_TYPE_BASE);
+  // Initialize stream buffer to manage page switches
+  gdp_page_events = xStreamBufferCreateStatic(PBUS_EVENTS * PBUS_QUEUE_IS,
+					      PBUS_QUEUE_IS,
+					      &(ucGDPPageEventStorage[0]),
+					      &gdp_page_events_buf);
 
   monitor_status = xTaskCreate(gdp_page_monitor,
 			       "GDP_PAGE_TASK",
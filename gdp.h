@@ -28,20 +28,90 @@
 
 #include <FreeRTOS.h>
 #include <task.h>
-#include <queue.h>
+#include <stream_buffer.h>
 
-// Queue for receiving commands
-extern QueueHandle_t gdp_queue;
-extern QueueHandle_t gdp_page_queue;
+// Stream buffers for receiving commands (bus events)
+extern StreamBufferHandle_t gdp_events;
+extern StreamBufferHandle_t gdp_page_events;
 
 // IO handling in assembler
 extern void gdp_sendcmd (void);
 extern void gdp_setpages (void);
+extern void gdpx_putdata (void);
+extern void gdpx_getdata (void);
+extern void gdpx_setadrl (void);
+extern void gdpx_setadrh (void);
+extern void gdpx_putfont (void);
+extern void gdpx_getlist (void);
 
 extern int init_gdp ();
 
+// Graphics memory (4 pages), page shown and page for drawing
+extern uint32_t graphmem_4p[16384];
+extern uint32_t *graphmem;
+extern uint32_t *graphmem_write;
+
+// Performance counters, shown by the monitor
+typedef struct gdp_stats_s {
+  uint32_t commands;     // Commands written to the EF9365 command register
+  uint32_t vectors;      // Lines drawn (through either interface)
+  uint32_t list_bytes;   // Bytes executed from the command list
+  uint32_t busy_us;      // Time spent executing commands
+  uint32_t model_us;     // Time the EF9365 would have needed for the commands
+  uint32_t held;         // Commands that waited for the beam
+  uint32_t held_us;      // Time spent waiting for the beam
+} gdp_stats_t;
+
+extern gdp_stats_t gdp_stats;
+
+// Speed of the drawing commands
+#define GDP_SPEED_TURBO      0   // Commands complete as fast as possible
+#define GDP_SPEED_AUTHENTIC  1   // Commands take as long as on the EF9365
+
+extern uint8_t gdp_speed;
+extern uint32_t gdp_cmd_cost (unsigned char gdp_cmd);
+extern void gdp_exec_command (unsigned char gdp_cmd);
+extern uint32_t gdp_time_trace (uint32_t *model_us);
+extern void gdp_cmd_rows (unsigned char gdp_cmd, int *y0, int *y1);
+extern void gdp_beam_hold (int y0, int y1);
+
+// Runs a function in the GDP task between two commands
+extern void gdp_call (void (*fn) (void *arg), void *arg);
+
+// Registers that tests and measurements in the GDP task may change
+// (see gdp_regs_lend)
+#define GDP_LEND_REGS 10
+
+typedef struct gdp_regs_save_s {
+  uint8_t ready;                 // GDP was ready before
+  uint8_t z80[GDP_LEND_REGS];    // Values of the Z80
+  uint8_t own[GDP_LEND_REGS];    // Values last set by the GDP task
+} gdp_regs_save_t;
+
+extern void gdp_regs_lend (gdp_regs_save_t *save);
+extern void gdp_regs_note (gdp_regs_save_t *save);
+extern void gdp_regs_return (gdp_regs_save_t *save);
+
+extern uint8_t gdp_pen;
+extern void gdp_update_pen ();
+
+// Rectangle in screen coordinates (edges inclusive)
+typedef struct gdp_rect_s {
+  int x0, y0;
+  int x1, y1;
+} gdp_rect;
+
+extern gdp_rect gdp_clip;
+extern void gdp_update_clip ();
+
 extern void plot_pixel (int x, int y);
 extern void clear_pixel (int x, int y);
+extern void fill_span (int x0, int x1, int y);
+extern void fill_rect (int x0, int y0, int x1, int y1);
+extern void gdp_fill_start (uint32_t *dst, uint32_t value, unsigned int words);
+extern bool gdp_fill_busy ();
+extern void gdp_fill_wait ();
+extern void blit_row (const uint32_t *pat, int n, int x, int y);
 
 extern void gdp_proc_command (unsigned char gdp_cmd);
 extern void gdp_set_pages (unsigned int r_page, unsigned int w_page);
@@ -61,4 +131,36 @@ extern void gdp_set_pages (unsigned int r_page, unsigned int w_page);
 #define gdp_xlp     (GDP_BASE + 12)
 #define gdp_ylp     (GDP_BASE + 13)
 
+// GDPico64 extension registers (not part of the EF9365). These are
+// placed on ports that are not used by the standard NKC cards.
+#define GDPX_BASE 0x90
+
+#define gdpx_ctrl   (GDPX_BASE)
+#define gdpx_adrl   (GDPX_BASE + 1)
+#define gdpx_adrh   (GDPX_BASE + 2)
+#define gdpx_data   (GDPX_BASE + 3)
+#define gdpx_fcfg   (GDPX_BASE + 4)
+#define gdpx_fadrl  (GDPX_BASE + 5)
+#define gdpx_fadrh  (GDPX_BASE + 6)
+#define gdpx_fdata  (GDPX_BASE + 7)
+#define gdpx_list   (GDPX_BASE + 8)
+#define gdpx_clipx0l (GDPX_BASE + 9)
+#define gdpx_clipx0h (GDPX_BASE + 10)
+#define gdpx_clipx1l (GDPX_BASE + 11)
+#define gdpx_clipx1h (GDPX_BASE + 12)
+#define gdpx_clipy0  (GDPX_BASE + 13)
+#define gdpx_clipy1  (GDPX_BASE + 14)
+
+// Bits of the extension control register
+#define GDPX_CTRL_XOR   0x01   // Pen complements pixels instead of setting them
+#define GDPX_CTRL_FONT  0x02   // Characters are taken from the font RAM
+#define GDPX_CTRL_PROP  0x04   // Proportional spacing (advance from font RAM)
+#define GDPX_CTRL_SYNC  0x08   // Drawing on the shown page waits for the beam
+
+// Pixel operations (see gdp_update_pen)
+#define GDP_PEN_NONE  0
+#define GDP_PEN_SET   1
+#define GDP_PEN_CLEAR 2
+#define GDP_PEN_XOR   3
+
 #endif
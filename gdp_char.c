@@ -25,6 +25,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "par_bus.h"
 #include "gdp.h"
@@ -140,20 +141,592 @@ const unsigned char charset[97][5]={{0x00,0x00,0x00,0x00,0x00},        /* ' ' wh
              };
 
 
-unsigned int x_cnt,
-  y_cnt,
-  xs_cnt,
-  ys_cnt,
-  pix_cnt = 0;
+// Font RAM, loaded by the Z80 through the font data port
+gdp_font font_ram;
 
 
 /****************************************************************************
- * Name: draw_char
+ * Name: init_font
+ *
+ * Description:
+ *   Preloads the font RAM with the built-in character set. In contrast
+ *   to the built-in set, the font RAM contains the ASCII versions of
+ *   '_' and '~' instead of the EF9365 left arrow and hook.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void init_font ()
+{
+  const unsigned char underscore[5] = {0x80,0x80,0x80,0x80,0x80};
+  const unsigned char tilde[5] = {0x18,0x04,0x08,0x10,0x0C};
+
+  memset (&font_ram, 0, sizeof (font_ram));
+  for (unsigned int a = 0x20; a <= 0x80; ++a)
+    {
+      const unsigned char *data = &(charset[a - 0x20][0]);
+      if (a == '_')
+	data = underscore;
+      if (a == '~')
+	data = tilde;
+
+      for (unsigned int i = 0; i < 5; ++i)
+	font_ram.glyph[a][i] = data[i];
+      font_ram.adv[a] = 6;
+    }
+}
+
+// Cache of glyphs in the layout used by the render paths. Entries are
+// built at first use of a character and rebuilt when the font RAM or
+// the glyph size has changed.
+#define GLYPH_CACHE_SIZE 64
+
+typedef struct glyph_entry_s
+{
+  uint32_t key;        // Character, source and glyph size (0: unused)
+  uint32_t gen;        // Font RAM generation the entry was built from
+  uint16_t rows[16];   // Row j (0: bottom), bit 15 is the left column
+  uint16_t cols[16];   // Column i (0: left), bit 15 is the bottom row
+} glyph_entry;
+
+static glyph_entry glyph_cache[GLYPH_CACHE_SIZE];
+
+// Draw characters pixel by pixel (reference for test_char_paths)
+static int char_pixelwise = 0;
+
+/****************************************************************************
+ * Name: get_glyph
+ *
+ * Description:
+ *   Looks the glyph up in the glyph cache. If it is not there, the
+ *   columns are taken from the font and the rotated copy (rows) is
+ *   built.
+ *
+ * Input Parameters:
+ *   a      - Character
+ *   font   - Non-zero for the font RAM, zero for the built-in set
+ *   width  - Glyph width (columns)
+ *   height - Glyph height (rows)
+ *
+ * Returned Value:
+ *   Cache entry of the glyph
+ *
+ ****************************************************************************/
+
+static const glyph_entry *get_glyph (unsigned char a, int font,
+				     unsigned int width, unsigned int height)
+{
+  glyph_entry *g = &glyph_cache[a & (GLYPH_CACHE_SIZE - 1)];
+  uint32_t key = 0x80000000u | a | (font ? 0x100 : 0) |
+    ((width - 1) << 9) | ((height - 1) << 13),
+    gen = font ? font_ram.gen : 0;
+
+  if ((g->key == key) && (g->gen == gen))
+    return (g);
+
+  memset (g, 0, sizeof (glyph_entry));
+  for (unsigned int i = 0; i < width; ++i)
+    {
+      unsigned int c;
+      if (font)
+	c = font_ram.glyph[a][i];
+      else
+	c = charset[((a < 0x20u) || (a > 0x80u)) ? 0x0 : (a - 0x20u)][i];
+
+      // Font data has the bottom row in bit height - 1
+      g->cols[i] = (c << (16 - height)) & 0xFFFF;
+      for (unsigned int j = 0; j < height; ++j)
+	if (g->cols[i] & (0x8000u >> j))
+	  g->rows[j] |= 0x8000u >> i;
+    }
+
+  g->key = key;
+  g->gen = gen;
+  return (g);
+}
+
+/****************************************************************************
+ * Name: set_run
+ *
+ * Description:
+ *   Sets the bits b0 .. b1 in a bit pattern (bit 31 of the first word
+ *   is bit 0).
+ *
+ * Input Parameters:
+ *   pat    - Pattern
+ *   b0     - First bit
+ *   b1     - Last bit (inclusive)
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void set_run (uint32_t *pat, unsigned int b0, unsigned int b1)
+{
+  unsigned int w0 = b0 >> 5,
+    w1 = b1 >> 5;
+  uint32_t m0 = 0xFFFFFFFFu >> (b0 & 0x1F),
+    m1 = 0xFFFFFFFFu << (31 - (b1 & 0x1F));
+
+  if (w0 == w1)
+    pat[w0] |= m0 & m1;
+  else
+    {
+      pat[w0] |= m0;
+      for (unsigned int w = w0 + 1; w < w1; ++w)
+	pat[w] = 0xFFFFFFFFu;
+      pat[w1] |= m1;
+    }
+}
+
+/****************************************************************************
+ * Name: expand_bits
+ *
+ * Description:
+ *   Scales a row (or column) of a glyph into a bit pattern for blit_row.
+ *   Every bit becomes scale bits. Consecutive set bits are filled as
+ *   one run.
+ *
+ * Input Parameters:
+ *   pat    - Pattern (8 words)
+ *   bits   - Glyph bits, bit 15 comes first
+ *   scale  - Scaling factor (1 .. 16)
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void expand_bits (uint32_t *pat, uint16_t bits, unsigned int scale)
+{
+  uint32_t v = (uint32_t) bits << 16;
+  unsigned int k = 0;
+
+  memset (pat, 0, 8 * sizeof (uint32_t));
+  if (scale == 1)
+    {
+      pat[0] = v;
+      return;
+    }
+
+  while (v != 0)
+    {
+      // Skip the zeros, then fill the run of ones
+      unsigned int z = __builtin_clz (v);
+      v <<= z;
+      k += z;
+      unsigned int o = __builtin_clz (~v);
+      set_run (pat, k * scale, (k + o) * scale - 1);
+      v <<= o;
+      k += o;
+    }
+}
+
+/****************************************************************************
+ * Name: build_diag_row
+ *
+ * Description:
+ *   Builds the bit pattern of one screen line of a vertical, slanted
+ *   character. The pixel of glyph column c and glyph row r (both scaled)
+ *   is at (x_ref + r, y_ref - c - r), so line d = c + r crosses the glyph
+ *   diagonally. The pattern is built from runs where both the glyph row
+ *   and the glyph column stay the same.
+ *
+ * Input Parameters:
+ *   pat    - Pattern (8 words), bit r is glyph row r
+ *   g      - Glyph
+ *   d      - Line below the reference point
+ *   w_pix  - Scaled width of the glyph
+ *   h_pix  - Scaled height of the glyph
+ *   size_x - Scaling factor of the columns
+ *   size_y - Scaling factor of the rows
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void build_diag_row (uint32_t *pat, const glyph_entry *g, int d,
+			    int w_pix, int h_pix, int size_x, int size_y)
+{
+  int r_lo = (d > w_pix - 1) ? d - (w_pix - 1) : 0,
+    r_hi = (d < h_pix - 1) ? d : h_pix - 1;
+
+  memset (pat, 0, 8 * sizeof (uint32_t));
+  for (int j = r_lo / size_y; j <= r_hi / size_y; ++j)
+    {
+      if (g->rows[j] == 0)
+	continue;
+
+      int rj0 = (j * size_y > r_lo) ? j * size_y : r_lo,
+	rj1 = (j * size_y + size_y - 1 < r_hi) ? j * size_y + size_y - 1 : r_hi;
+
+      // Glyph columns crossed by this part of the line
+      for (int i = (d - rj1) / size_x; i <= (d - rj0) / size_x; ++i)
+	if (g->rows[j] & (0x8000u >> i))
+	  {
+	    int r0 = d - i * size_x - size_x + 1,
+	      r1 = d - i * size_x;
+	    set_run (pat, (r0 > rj0) ? r0 : rj0, (r1 < rj1) ? r1 : rj1);
+	  }
+    }
+}
+
+/****************************************************************************
+ * Name: draw_char_pixels
+ *
+ * Description:
+ *   Draws a character pixel by pixel. This is the straightforward
+ *   implementation of all orientations, which is used as reference for
+ *   the render paths in draw_char.
+ *
+ * Input Parameters:
+ *   g        - Glyph
+ *   width    - Glyph width
+ *   height   - Glyph height
+ *   size_x   - Scaling factor of the columns
+ *   size_y   - Scaling factor of the rows
+ *   ctrlreg2 - Orientation (CTRL2)
+ *   x_ref    - x coordinate of the reference point
+ *   y_ref    - y coordinate of the reference point
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void draw_char_pixels (const glyph_entry *g,
+			      unsigned int width, unsigned int height,
+			      unsigned int size_x, unsigned int size_y,
+			      uint8_t ctrlreg2, int x_ref, int y_ref)
+{
+  int x_plot, y_plot,
+    pos_buf = (ctrlreg2 & 0x8) ? y_ref : x_ref;
+
+  for (unsigned int i = 0; i < width; ++i)
+    {
+      unsigned int ldat = g->cols[i];
+      for (unsigned int isi = 0; isi < size_x; ++isi)
+	{
+	  x_plot = pos_buf;
+	  y_plot = (ctrlreg2 & 0x8) ? x_ref : y_ref;
+
+	  for (unsigned int j = 0; j < height; ++j)
+	    {
+	      for (unsigned int jsi = 0; jsi < size_y; ++jsi)
+		{
+		  if (ldat & (0x8000u >> j))
+		    {
+		      if (ctrlreg2 & 0x8)
+			plot_pixel (y_plot, x_plot);
+		      else
+			plot_pixel (x_plot, y_plot);
+		    }
+
+		  ++y_plot;
+		  if (ctrlreg2 & 0x4)
+		    x_plot += (ctrlreg2 & 0x8) ? -1 : 1;
+		}
+	    }
+
+	  pos_buf += (ctrlreg2 & 0x8) ? -1 : 1;
+	}
+    }
+}
+
+// Size and glyph of a character
+typedef struct char_geom_s
+{
+  const glyph_entry *g;
+  unsigned int width, height, adv;
+  unsigned int size_x, size_y;
+  uint8_t ctrl2;
+} char_geom;
+
+/****************************************************************************
+ * Name: get_char_geom
+ *
+ * Description:
+ *   Determines glyph, glyph size, advance and scaling of a character.
+ *   The glyph either comes from the built-in character set (5x8) or,
+ *   when enabled in the extension control register, from the font RAM
+ *   with the glyph size from the font configuration register.
+ *
+ * Input Parameters:
+ *   a      - Character
+ *   attr   - Character attributes
+ *   cg     - Result
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void get_char_geom (unsigned char a, const gdp_text_attr *attr,
+			   char_geom *cg)
+{
+  if (attr->xctrl & GDPX_CTRL_FONT)
+    {
+      cg->width = (attr->fcfg & 0xF) + 1;
+      cg->height = (attr->fcfg & 0x10) ? 16 : 8;
+      cg->adv = (attr->xctrl & GDPX_CTRL_PROP) ? font_ram.adv[a] : cg->width + 1;
+      cg->g = get_glyph (a, 1, cg->width, cg->height);
+    }
+  else
+    {
+      cg->width = 5;
+      cg->height = 8;
+      cg->adv = 6;
+      cg->g = get_glyph (a, 0, cg->width, cg->height);
+    }
+
+  cg->ctrl2 = attr->ctrl2;
+  cg->size_x = (attr->csize & 0xF0) >> 4;
+  cg->size_y = (attr->csize & 0xF);
+  if (cg->size_x == 0)
+    cg->size_x = 16;
+  if (cg->size_y == 0)
+    cg->size_y = 16;
+}
+
+/****************************************************************************
+ * Name: get_char_box
+ *
+ * Description:
+ *   Computes the bounding box of a character at the reference point
+ *   and moves the reference point to the next character.
+ *
+ * Input Parameters:
+ *   cg     - Character
+ *   x_ref  - x coordinate of the reference point, updated
+ *   y_ref  - y coordinate of the reference point, updated
+ *   box    - Bounding box
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void get_char_box (const char_geom *cg, unsigned int *x_ref,
+			  unsigned int *y_ref, gdp_rect *box)
+{
+  int w_pix = cg->width * cg->size_x,
+    h_pix = cg->height * cg->size_y,
+    skew = (cg->ctrl2 & 0x4) ? h_pix - 1 : 0;
+
+  if (cg->ctrl2 & 0x8)
+    {
+      box->x0 = *x_ref;
+      box->x1 = *x_ref + h_pix - 1;
+      box->y0 = (int) *y_ref - (w_pix - 1) - skew;
+      box->y1 = *y_ref;
+      *y_ref += cg->adv * cg->size_x;
+    }
+  else
+    {
+      box->x0 = *x_ref;
+      box->x1 = *x_ref + (w_pix - 1) + skew;
+      box->y0 = *y_ref;
+      box->y1 = *y_ref + h_pix - 1;
+      *x_ref += cg->adv * cg->size_x;
+    }
+}
+
+/****************************************************************************
+ * Name: get_text_attr
+ *
+ * Description:
+ *   Reads the character attributes from the registers.
+ *
+ * Input Parameters:
+ *   attr   - Result
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void get_text_attr (gdp_text_attr *attr)
+{
+  attr->xctrl = read_io_reg (gdpx_ctrl);
+  attr->fcfg = read_io_reg (gdpx_fcfg);
+  attr->ctrl2 = read_io_reg (gdp_ctrl2);
+  attr->csize = read_io_reg (gdp_csize);
+}
+
+/****************************************************************************
+ * Name: text_box
+ *
+ * Description:
+ *   Computes the bounding box of a text (without drawing it).
+ *
+ * Input Parameters:
+ *   str    - Characters
+ *   n      - Number of characters (at least 1)
+ *   attr   - Character attributes
+ *   x_ref  - x coordinate of the reference point of the first character
+ *   y_ref  - y coordinate of the reference point of the first character
+ *   box    - Bounding box
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void text_box (const uint8_t *str, unsigned int n, const gdp_text_attr *attr,
+	       unsigned int x_ref, unsigned int y_ref, gdp_rect *box)
+{
+  char_geom cg;
+  gdp_rect cbox;
+
+  for (unsigned int i = 0; i < n; ++i)
+    {
+      get_char_geom (str[i], attr, &cg);
+      get_char_box (&cg, &x_ref, &y_ref, &cbox);
+      if ((i == 0) || (cbox.x0 < box->x0))
+	box->x0 = cbox.x0;
+      if ((i == 0) || (cbox.y0 < box->y0))
+	box->y0 = cbox.y0;
+      if ((i == 0) || (cbox.x1 > box->x1))
+	box->x1 = cbox.x1;
+      if ((i == 0) || (cbox.y1 > box->y1))
+	box->y1 = cbox.y1;
+    }
+}
+
+/****************************************************************************
+ * Name: render_char
  *
  * Description:
  *   Draws a character according to the description in the EF9365
  *   datasheet. Implements skewed and scaled characters.
- *   TODO: 5x5 Block drawing not yet implemented!
+ *   All orientations are drawn line by line as bit patterns:
+ *   - Upright characters (slanted or not) from the glyph rows. Slanted
+ *     lines are shifted by one pixel per line.
+ *   - Vertical characters from the glyph columns, which are lines on
+ *     the screen.
+ *   - Vertical slanted characters from lines that cross the glyph
+ *     diagonally.
+ *   Characters outside the clip rectangle are skipped as a whole.
+ *
+ * Input Parameters:
+ *   a      - Character
+ *   attr   - Character attributes
+ *   x_ref  - x coordinate of the reference point, moved to the next
+ *            character
+ *   y_ref  - y coordinate of the reference point, moved to the next
+ *            character
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void render_char (unsigned char a, const gdp_text_attr *attr,
+		  unsigned int *x_ref_p, unsigned int *y_ref_p)
+{
+  char_geom cg;
+  gdp_rect box;
+  unsigned int x_ref = *x_ref_p,
+    y_ref = *y_ref_p;
+
+  get_char_geom (a, attr, &cg);
+  get_char_box (&cg, x_ref_p, y_ref_p, &box);
+
+  // For debugging, define reference point
+  // plot_pixel (x_ref, y_ref);
+
+  const glyph_entry *g = cg.g;
+  unsigned int width = cg.width,
+    height = cg.height,
+    size_x = cg.size_x,
+    size_y = cg.size_y;
+  uint8_t ctrlreg2 = cg.ctrl2;
+  int w_pix = width * size_x,
+    h_pix = height * size_y;
+  uint32_t pat[8];
+
+  if ((gdp_pen == GDP_PEN_NONE) ||
+      (box.x0 > gdp_clip.x1) || (box.x1 < gdp_clip.x0) ||
+      (box.y0 > gdp_clip.y1) || (box.y1 < gdp_clip.y0))
+    {
+      // Nothing to draw, only move
+    }
+  else if (char_pixelwise)
+    draw_char_pixels (g, width, height, size_x, size_y, ctrlreg2, x_ref, y_ref);
+  else if ((ctrlreg2 & 0x8) == 0)
+    {
+      // Upright characters. Each glyph row is expanded into a bit pattern
+      // (up to 16 columns * 16 = 256 pixels) which is then applied to
+      // size_y lines of the framebuffer.
+      int y_plot = y_ref;
+      for (unsigned int j = 0; j < height; ++j, y_plot += size_y)
+	{
+	  // Only the glyph rows that hit the clip rectangle
+	  if (y_plot + (int) size_y - 1 < gdp_clip.y0)
+	    continue;
+	  if (y_plot > gdp_clip.y1)
+	    break;
+	  if (g->rows[j] == 0)
+	    continue;
+
+	  expand_bits (pat, g->rows[j], size_x);
+	  for (unsigned int jsi = 0; jsi < size_y; ++jsi)
+	    blit_row (pat, w_pix, x_ref + ((ctrlreg2 & 0x4) ? j * size_y + jsi : 0),
+		      y_plot + jsi);
+	}
+    }
+  else if ((ctrlreg2 & 0x4) == 0)
+    {
+      // Vertical characters. Each glyph column is a line on the screen,
+      // going downwards from the reference point.
+      int y_plot = y_ref;
+      for (unsigned int i = 0; i < width; ++i, y_plot -= size_x)
+	{
+	  if (y_plot - (int) size_x + 1 > gdp_clip.y1)
+	    continue;
+	  if (y_plot < gdp_clip.y0)
+	    break;
+	  if (g->cols[i] == 0)
+	    continue;
+
+	  expand_bits (pat, g->cols[i], size_y);
+	  for (unsigned int isi = 0; isi < size_x; ++isi)
+	    blit_row (pat, h_pix, x_ref, y_plot - isi);
+	}
+    }
+  else
+    {
+      // Vertical slanted characters. Only the lines within the clip
+      // rectangle are built.
+      int d0 = (int) y_ref - gdp_clip.y1,
+	d1 = (int) y_ref - gdp_clip.y0;
+      if (d0 < 0)
+	d0 = 0;
+      if (d1 > w_pix + h_pix - 2)
+	d1 = w_pix + h_pix - 2;
+
+      for (int d = d0; d <= d1; ++d)
+	{
+	  build_diag_row (pat, g, d, w_pix, h_pix, size_x, size_y);
+	  blit_row (pat, h_pix, x_ref, y_ref - d);
+	}
+    }
+}
+
+/****************************************************************************
+ * Name: draw_char
+ *
+ * Description:
+ *   Implements the character commands of the EF9365 with the attributes
+ *   and the position from the registers (see render_char). Afterwards
+ *   the position registers point to the next character.
  *
  * Input Parameters:
  *   c     - As provided in the respective GDP command. Usually
@@ -166,71 +739,98 @@ unsigned int x_cnt,
 
 void draw_char (unsigned char a)
 {
-  // Limit to valid values
-  unsigned char c = ((a < 0x20u) || (a > 0x80u)) ? 0x0 : (a-0x20u);
-  // Get pointer into data array
-  const unsigned char *data = &(charset[c][0]);
+  gdp_text_attr attr;
+  unsigned int x_ref = read_io_reg(gdp_xmsb) * 256 + read_io_reg(gdp_xlsb),
+    y_ref = read_io_reg(gdp_ymsb) * 256 + read_io_reg(gdp_ylsb);
 
-  // Initiation of drawing action
-  if (pix_cnt == 0)
+  get_text_attr (&attr);
+  render_char (a, &attr, &x_ref, &y_ref);
+
+  // Adjust position register (From gdp64.c nkcemu)
+  if (attr.ctrl2 & 0x8)
     {
+      write_io_reg (gdp_ymsb, (y_ref >> 8) & 0xFF);
+      write_io_reg (gdp_ylsb, y_ref & 0xFF);
     }
+  else
+    {
+      write_io_reg (gdp_xmsb, (x_ref >> 8) & 0xFF);
+      write_io_reg (gdp_xlsb, x_ref & 0xFF);
+    }
+}
 
-  uint8_t ctrlreg1 = read_io_reg (gdp_ctrl1);
+/****************************************************************************
+ * Name: draw_block
+ *
+ * Description:
+ *   Implements the 5x8 block drawing command (0xA) of the EF9365. The
+ *   result is the same as drawing the all-set 5x8 character, but the
+ *   block is filled as a sequence of horizontal runs instead of single
+ *   pixels. Scaling (CSIZE), vertical writing and skewing (CTRL2) as well
+ *   as the position update follow draw_char.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void draw_block ()
+{
   uint8_t ctrlreg2 = read_io_reg (gdp_ctrl2);
 
   uint8_t siz = read_io_reg (gdp_csize);
-  unsigned int size_x = (siz & 0xF0) >> 4,
+  int size_x = (siz & 0xF0) >> 4,
     size_y = (siz & 0xF);
   if (size_x == 0)
     size_x = 16;
   if (size_y == 0)
     size_y = 16;
 
-  unsigned int x_ref = read_io_reg(gdp_xmsb) * 256 + read_io_reg(gdp_xlsb),
+  int x_ref = read_io_reg(gdp_xmsb) * 256 + read_io_reg(gdp_xlsb),
     y_ref = read_io_reg(gdp_ymsb) * 256 + read_io_reg(gdp_ylsb);
 
-  // For debugging, define reference point
-  // plot_pixel (x_ref, y_ref);
-
-  int x_plot, y_plot,
-    pos_buf = (ctrlreg2 & 0x8) ? y_ref : x_ref;
+  // Block is 5 columns wide and 8 rows high (before scaling)
+  int w = 5 * size_x,
+    h = 8 * size_y;
 
-  if (ctrlreg1 & 0x1)
+  if (gdp_pen != GDP_PEN_NONE)
     {
-      for (unsigned int i = 0; i < 5; ++i)
+      switch (ctrlreg2 & 0xC)
 	{
-	  unsigned char ldat = *data;
-	  for (unsigned int isi = 0; isi < size_x; ++isi)
+	case 0x0:
+	  // Upright block
+	  fill_rect (x_ref, y_ref, x_ref + w - 1, y_ref + h - 1);
+	  break;
+	case 0x4:
+	  // Skewed, every row is shifted by one pixel to the right
+	  for (int r = 0; r < h; ++r)
+	    fill_span (x_ref + r, x_ref + r + w - 1, y_ref + r);
+	  break;
+	case 0x8:
+	  // Vertical writing, rows run along x, columns downwards
+	  fill_rect (x_ref, y_ref - w + 1, x_ref + h - 1, y_ref);
+	  break;
+	case 0xC:
+	  // Vertical and skewed, row r covers y_ref-r-w+1..y_ref-r
+	  // at x_ref+r. Collect the runs line by line.
+	  for (int y = y_ref - h - w + 2; y <= y_ref; ++y)
 	    {
-	      x_plot = pos_buf;
-	      y_plot = (ctrlreg2 & 0x8) ? x_ref : y_ref;
-	      
-	      for (unsigned int j = 0; j < 8; ++j)
-		{
-		  for (unsigned int jsi = 0; jsi < size_y; ++jsi)
-		    {
-		      if (ldat & (0x80 >> j))
-			{
-			  if (ctrlreg2 & 0x8)
-			    plot_pixel (y_plot, x_plot);
-			  else
-			    plot_pixel (x_plot, y_plot);
-			}
-		      
-		      ++y_plot;
-		      if (ctrlreg2 & 0x4)
-			x_plot += (ctrlreg2 & 0x8) ? -1 : 1;
-		    }
-		}
-	      
-	      pos_buf += (ctrlreg2 & 0x8) ? -1 : 1;
+	      int r0 = y_ref - y - w + 1,
+		r1 = y_ref - y;
+	      if (r0 < 0)
+		r0 = 0;
+	      if (r1 > h - 1)
+		r1 = h - 1;
+	      fill_span (x_ref + r0, x_ref + r1, y);
 	    }
-	  data++;
+	  break;
 	}
     }
 
-  // Adjust position register (From gdp64.c nkcemu)
+  // Adjust position register (same as for characters)
   if (ctrlreg2 & 0x8)
     {
       y_ref += 6*size_x;
@@ -242,21 +842,7 @@ void draw_char (unsigned char a)
       x_ref += 6*size_x;
       write_io_reg (gdp_xmsb, (x_ref >> 8) & 0xFF);
       write_io_reg (gdp_xlsb, x_ref & 0xFF);
-    }    
-
-  /*
-  pos_buf += size_x;
-  if (ctrlreg2 & 0x8)
-    {
-      gdp64->ymsb = (pos_buf >> 8) & 0xFF;
-      gdp64->ylsb = pos_buf & 0xFF;
-    }
-  else
-    {
-      gdp64->xmsb = (pos_buf >> 8) & 0xFF;
-      gdp64->xlsb = pos_buf & 0xFF;
     }
-  */
 }
 
 /****************************************************************************
@@ -322,3 +908,118 @@ void test_draw_char ()
     draw_char (i);
   
 }
+
+// Checksum of the drawing page
+static uint32_t page_checksum ()
+{
+  uint32_t sum = 0;
+  for (unsigned int i = 0; i < 4096; ++i)
+    sum = ((sum << 5) | (sum >> 27)) ^ graphmem_write[i];
+  return (sum);
+}
+
+/****************************************************************************
+ * Name: char_path_test
+ *
+ * Description:
+ *   Verifies that the render paths of draw_char produce the same pixels
+ *   and positions as drawing pixel by pixel. All characters of the
+ *   built-in set and the font RAM are drawn in the four orientations
+ *   (upright, slanted, vertical, vertical slanted) with several sizes
+ *   and positions (some of them partly off the screen). Each character
+ *   is drawn twice in XOR mode, once by draw_char and once pixel by
+ *   pixel. If both are identical, the second one removes the first one
+ *   again, which is checked with a checksum of the drawing page. Thus
+ *   the test works on any page without destroying its contents.
+ *   Runs in the GDP task (see test_char_paths), the registers are lent
+ *   by the Z80 (see gdp_regs_lend).
+ *
+ * Input Parameters:
+ *   arg    - Number of characters that differ, returned (int)
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void char_path_test (void *arg)
+{
+  const uint8_t sizes[] = {0x11, 0x21, 0x12, 0x32, 0x00};
+  const uint16_t pos[][2] = {{200, 120}, {500, 250}, {3, 2}};
+  gdp_regs_save_t save;
+  uint8_t save_pen = gdp_pen;
+  gdp_rect save_clip = gdp_clip;
+  int errors = 0;
+
+  gdp_regs_lend (&save);
+  gdp_fill_wait ();
+  gdp_pen = GDP_PEN_XOR;
+  gdp_clip.x0 = 0;
+  gdp_clip.y0 = 0;
+  gdp_clip.x1 = 511;
+  gdp_clip.y1 = 255;
+
+  for (unsigned int font = 0; font < 2; ++font)
+    for (unsigned int orient = 0; orient < 0x10; orient += 4)
+      for (unsigned int s = 0; s < sizeof (sizes); ++s)
+	for (unsigned int p = 0; p < sizeof (pos) / sizeof (pos[0]); ++p)
+	  for (unsigned int a = 0x20; a <= 0x80; ++a)
+	    {
+	      uint32_t sum = page_checksum ();
+	      uint8_t xy[2][4];
+
+	      write_io_reg (gdpx_ctrl, font ? GDPX_CTRL_FONT : 0);
+	      write_io_reg (gdp_ctrl2, orient);
+	      write_io_reg (gdp_csize, sizes[s]);
+	      for (unsigned int k = 0; k < 2; ++k)
+		{
+		  write_io_reg (gdp_xmsb, pos[p][0] >> 8);
+		  write_io_reg (gdp_xlsb, pos[p][0] & 0xFF);
+		  write_io_reg (gdp_ymsb, pos[p][1] >> 8);
+		  write_io_reg (gdp_ylsb, pos[p][1] & 0xFF);
+		  char_pixelwise = k;
+		  draw_char (a);
+		  for (unsigned int r = 0; r < 4; ++r)
+		    xy[k][r] = read_io_reg (gdp_xmsb + r);
+		}
+	      char_pixelwise = 0;
+	      gdp_regs_note (&save);
+
+	      if ((page_checksum () != sum) || memcmp (xy[0], xy[1], 4))
+		{
+		  if (errors < 10)
+		    printf ("Char %02x font %d ctrl2 %x csize %02x at %d,%d differs\n",
+			    a, font, orient, sizes[s], pos[p][0], pos[p][1]);
+		  ++errors;
+		}
+	    }
+
+  gdp_pen = save_pen;
+  gdp_clip = save_clip;
+  gdp_regs_return (&save);
+
+  *(int *) arg = errors;
+}
+
+/****************************************************************************
+ * Name: test_char_paths
+ *
+ * Description:
+ *   Runs the character self test (see char_path_test) in the GDP task
+ *   between two commands. While it runs, the GDP reports busy.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   Number of characters that differ
+ *
+ ****************************************************************************/
+
+int test_char_paths ()
+{
+  int errors;
+
+  gdp_call (char_path_test, &errors);
+  return (errors);
+}
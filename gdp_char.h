@@ -28,9 +28,45 @@
 #define _NDRNKC_GDP_CHAR_
 
 #include "pico/stdlib.h"
+#include "gdp.h"
 
+// Font RAM as seen through the font data port. Each glyph consists of
+// up to 16 columns of 16 bit (bit 0 is the upper row). Followed
+// by the advance widths (in columns) of all glyphs.
+#define FONT_RAM_SIZE 0x2100
+
+typedef struct gdp_font_s
+{
+  uint16_t glyph[256][16];
+  uint8_t adv[256];
+  volatile uint32_t gen;   // Counts the writes through the font data port
+} gdp_font;
+
+extern gdp_font font_ram;
+
+// Built-in character set (5 columns per character, from 0x20)
+extern const unsigned char charset[97][5];
+
+extern void init_font ();
+
+// Character attributes (register values)
+typedef struct gdp_text_attr_s
+{
+  uint8_t xctrl;   // Extension control (font RAM, proportional spacing)
+  uint8_t fcfg;    // Font RAM glyph size
+  uint8_t ctrl2;   // Orientation (vertical, slanted)
+  uint8_t csize;   // Scaling
+} gdp_text_attr;
+
+extern void get_text_attr (gdp_text_attr *attr);
+extern void text_box (const uint8_t *str, unsigned int n, const gdp_text_attr *attr,
+		      unsigned int x_ref, unsigned int y_ref, gdp_rect *box);
+extern void render_char (unsigned char a, const gdp_text_attr *attr,
+			 unsigned int *x_ref, unsigned int *y_ref);
 extern void draw_char (unsigned char a);
+extern void draw_block ();
 
 extern void test_draw_char ();
+extern int test_char_paths ();
 
 #endif
@@ -0,0 +1,495 @@
+/**
+ * gdp_dlist.c
+ *
+ * Retained display list for the GDP (GDPico64 extension). The Z80
+ * defines numbered objects (line strips and texts) once through the
+ * command list and afterwards only moves, hides or deletes them. On
+ * each frame command, the parts of the drawing page that have changed
+ * since the page was drawn the last time are cleared and redrawn from
+ * the objects. Then the drawing page is shown and the previously shown
+ * page becomes the drawing page (double buffering).
+ *
+ * Copyright (C) 2024  Oliver Kayser-Herold
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "par_bus.h"
+#include "gdp.h"
+#include "gdp_char.h"
+#include "gdp_line.h"
+#include "gdp_dlist.h"
+
+
+// Maximum number of changed areas per page. When more areas change,
+// they are combined into one.
+#define DL_DIRTY_MAX 8
+
+typedef struct dl_object_s
+{
+  uint8_t kind;          // DL_NONE, DL_STRIP or DL_TEXT
+  uint8_t visible;
+  uint16_t n;            // Number of vectors or characters
+  uint16_t ofs;          // Start of the vectors (dx, dy) or characters in the pool
+  uint16_t x, y;         // Start of the strip, reference point of the text
+  gdp_text_attr attr;    // Character attributes (text)
+  gdp_rect box;          // Bounding box at the current position
+} dl_object;
+
+static dl_object dl_obj[DL_OBJECTS];
+static uint8_t dl_pool[DL_POOL_SIZE];
+static unsigned int dl_pool_used;
+
+// Changed areas of each page that still need to be redrawn
+static gdp_rect dl_dirty[4][DL_DIRTY_MAX];
+static unsigned int dl_n_dirty[4];
+
+
+/****************************************************************************
+ * Name: dl_add_dirty
+ *
+ * Description:
+ *   Marks an area as changed on all pages.
+ *
+ * Input Parameters:
+ *   r      - Changed area
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void dl_add_dirty (const gdp_rect *r)
+{
+  gdp_rect c = *r;
+
+  // Only the part on the screen
+  if (c.x0 < 0)
+    c.x0 = 0;
+  if (c.y0 < 0)
+    c.y0 = 0;
+  if (c.x1 > 511)
+    c.x1 = 511;
+  if (c.y1 > 255)
+    c.y1 = 255;
+  if ((c.x0 > c.x1) || (c.y0 > c.y1))
+    return;
+
+  for (unsigned int p = 0; p < 4; ++p)
+    {
+      if (dl_n_dirty[p] == DL_DIRTY_MAX)
+	{
+	  // Combine all areas into the first one
+	  for (unsigned int i = 1; i < DL_DIRTY_MAX; ++i)
+	    {
+	      gdp_rect *d = &dl_dirty[p][i];
+	      if (d->x0 < dl_dirty[p][0].x0)
+		dl_dirty[p][0].x0 = d->x0;
+	      if (d->y0 < dl_dirty[p][0].y0)
+		dl_dirty[p][0].y0 = d->y0;
+	      if (d->x1 > dl_dirty[p][0].x1)
+		dl_dirty[p][0].x1 = d->x1;
+	      if (d->y1 > dl_dirty[p][0].y1)
+		dl_dirty[p][0].y1 = d->y1;
+	    }
+	  dl_n_dirty[p] = 1;
+	}
+      dl_dirty[p][dl_n_dirty[p]++] = c;
+    }
+}
+
+/****************************************************************************
+ * Name: dl_update_box
+ *
+ * Description:
+ *   Computes the bounding box of an object at its current position.
+ *
+ * Input Parameters:
+ *   o      - Object
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void dl_update_box (dl_object *o)
+{
+  const uint8_t *data = &dl_pool[o->ofs];
+
+  if (o->kind == DL_TEXT)
+    {
+      if (o->n > 0)
+	text_box (data, o->n, &o->attr, o->x, o->y, &o->box);
+      else
+	o->box = (gdp_rect) {1, 1, 0, 0};
+    }
+  else
+    {
+      int x = o->x,
+	y = o->y;
+
+      o->box.x0 = o->box.x1 = x;
+      o->box.y0 = o->box.y1 = y;
+      for (unsigned int i = 0; i < o->n; ++i)
+	{
+	  x += (int8_t) data[2 * i];
+	  y += (int8_t) data[2 * i + 1];
+	  if (x < o->box.x0)
+	    o->box.x0 = x;
+	  if (x > o->box.x1)
+	    o->box.x1 = x;
+	  if (y < o->box.y0)
+	    o->box.y0 = y;
+	  if (y > o->box.y1)
+	    o->box.y1 = y;
+	}
+    }
+}
+
+/****************************************************************************
+ * Name: dl_render
+ *
+ * Description:
+ *   Draws an object into the drawing page.
+ *
+ * Input Parameters:
+ *   o      - Object
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void dl_render (const dl_object *o)
+{
+  const uint8_t *data = &dl_pool[o->ofs];
+  unsigned int x = o->x,
+    y = o->y;
+
+  if (o->kind == DL_TEXT)
+    {
+      for (unsigned int i = 0; i < o->n; ++i)
+	render_char (data[i], &o->attr, &x, &y);
+    }
+  else
+    {
+      for (unsigned int i = 0; i < o->n; ++i)
+	{
+	  int dx = (int8_t) data[2 * i],
+	    dy = (int8_t) data[2 * i + 1];
+	  render_vector (x, y, dx, dy);
+	  x += dx;
+	  y += dy;
+	  ++gdp_stats.vectors;
+	}
+    }
+}
+
+/****************************************************************************
+ * Name: dl_remove
+ *
+ * Description:
+ *   Removes an object and releases its memory in the pool. The area
+ *   it covered is marked as changed.
+ *
+ * Input Parameters:
+ *   o      - Object
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void dl_remove (dl_object *o)
+{
+  if (o->kind == DL_NONE)
+    return;
+
+  if (o->visible)
+    dl_add_dirty (&o->box);
+
+  unsigned int len = (o->kind == DL_STRIP) ? 2 * o->n : o->n;
+  memmove (&dl_pool[o->ofs], &dl_pool[o->ofs + len],
+	   dl_pool_used - o->ofs - len);
+  dl_pool_used -= len;
+  for (unsigned int i = 0; i < DL_OBJECTS; ++i)
+    if ((dl_obj[i].kind != DL_NONE) && (dl_obj[i].ofs > o->ofs))
+      dl_obj[i].ofs -= len;
+
+  o->kind = DL_NONE;
+}
+
+/****************************************************************************
+ * Name: init_dlist
+ *
+ * Description:
+ *   Initializes the display list (no objects). The first frame clears
+ *   the whole page.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void init_dlist ()
+{
+  memset (dl_obj, 0, sizeof (dl_obj));
+  dl_pool_used = 0;
+  dl_clear ();
+}
+
+/****************************************************************************
+ * Name: dl_clear
+ *
+ * Description:
+ *   Deletes all objects.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void dl_clear ()
+{
+  const gdp_rect screen = {0, 0, 511, 255};
+
+  for (unsigned int i = 0; i < DL_OBJECTS; ++i)
+    dl_obj[i].kind = DL_NONE;
+  dl_pool_used = 0;
+
+  memset (dl_n_dirty, 0, sizeof (dl_n_dirty));
+  dl_add_dirty (&screen);
+}
+
+/****************************************************************************
+ * Name: dl_define
+ *
+ * Description:
+ *   Defines an object (replacing an existing object with the same
+ *   number). Text objects use the character attributes from the
+ *   registers at the time of the definition. New objects are visible.
+ *
+ * Input Parameters:
+ *   id     - Object number
+ *   kind   - DL_STRIP or DL_TEXT
+ *   x      - x coordinate of the start point or the first character
+ *   y      - y coordinate of the start point or the first character
+ *   n      - Number of vectors or characters
+ *   data   - Vectors (dx, dy as signed bytes) or characters
+ *
+ * Returned Value:
+ *   0 on success, -1 if there is not enough memory left
+ *
+ ****************************************************************************/
+
+int dl_define (uint8_t id, uint8_t kind, unsigned int x, unsigned int y,
+	       unsigned int n, const uint8_t *data)
+{
+  if ((id >= DL_OBJECTS) || ((kind != DL_STRIP) && (kind != DL_TEXT)))
+    return (-1);
+
+  dl_object *o = &dl_obj[id];
+  dl_remove (o);
+
+  unsigned int len = (kind == DL_STRIP) ? 2 * n : n;
+  if (dl_pool_used + len > DL_POOL_SIZE)
+    return (-1);
+
+  memcpy (&dl_pool[dl_pool_used], data, len);
+  o->ofs = dl_pool_used;
+  dl_pool_used += len;
+
+  o->kind = kind;
+  o->visible = 1;
+  o->n = n;
+  o->x = x;
+  o->y = y;
+  if (kind == DL_TEXT)
+    get_text_attr (&o->attr);
+  dl_update_box (o);
+  dl_add_dirty (&o->box);
+
+  return (0);
+}
+
+/****************************************************************************
+ * Name: dl_move
+ *
+ * Description:
+ *   Moves an object to a new position.
+ *
+ * Input Parameters:
+ *   id     - Object number
+ *   x      - x coordinate of the start point or the first character
+ *   y      - y coordinate of the start point or the first character
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void dl_move (uint8_t id, unsigned int x, unsigned int y)
+{
+  if ((id >= DL_OBJECTS) || (dl_obj[id].kind == DL_NONE))
+    return;
+
+  dl_object *o = &dl_obj[id];
+  if (o->visible)
+    dl_add_dirty (&o->box);
+  o->x = x;
+  o->y = y;
+  dl_update_box (o);
+  if (o->visible)
+    dl_add_dirty (&o->box);
+}
+
+/****************************************************************************
+ * Name: dl_rmove
+ *
+ * Description:
+ *   Moves an object relative to its position.
+ *
+ * Input Parameters:
+ *   id     - Object number
+ *   dx     - Movement along the x axis
+ *   dy     - Movement along the y axis
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void dl_rmove (uint8_t id, int dx, int dy)
+{
+  if ((id >= DL_OBJECTS) || (dl_obj[id].kind == DL_NONE))
+    return;
+
+  dl_move (id, (dl_obj[id].x + dx) & 0xFFFF, (dl_obj[id].y + dy) & 0xFFFF);
+}
+
+/****************************************************************************
+ * Name: dl_show
+ *
+ * Description:
+ *   Shows or hides an object.
+ *
+ * Input Parameters:
+ *   id      - Object number
+ *   visible - Non-zero to show the object
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void dl_show (uint8_t id, int visible)
+{
+  if ((id >= DL_OBJECTS) || (dl_obj[id].kind == DL_NONE))
+    return;
+
+  dl_object *o = &dl_obj[id];
+  visible = visible ? 1 : 0;
+  if (o->visible != visible)
+    {
+      o->visible = visible;
+      dl_add_dirty (&o->box);
+    }
+}
+
+/****************************************************************************
+ * Name: dl_delete
+ *
+ * Description:
+ *   Deletes an object.
+ *
+ * Input Parameters:
+ *   id     - Object number
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void dl_delete (uint8_t id)
+{
+  if (id < DL_OBJECTS)
+    dl_remove (&dl_obj[id]);
+}
+
+/****************************************************************************
+ * Name: dl_frame
+ *
+ * Description:
+ *   Brings the drawing page up to date: All areas that have changed
+ *   since this page was drawn the last time are cleared and the visible
+ *   objects within are drawn again (clipped to the area). Afterwards
+ *   the drawing page is shown and the page shown so far becomes the
+ *   drawing page. The page register is updated accordingly.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void dl_frame ()
+{
+  uint8_t pages = read_io_reg (0x60);
+  unsigned int r_page = (pages >> 4) & 0x3,
+    w_page = (pages >> 6) & 0x3;
+  uint8_t save_pen = gdp_pen;
+  gdp_rect save_clip = gdp_clip;
+
+  for (unsigned int d = 0; d < dl_n_dirty[w_page]; ++d)
+    {
+      const gdp_rect *r = &dl_dirty[w_page][d];
+
+      gdp_clip = *r;
+      gdp_pen = GDP_PEN_CLEAR;
+      fill_rect (r->x0, r->y0, r->x1, r->y1);
+      gdp_fill_wait ();
+
+      gdp_pen = GDP_PEN_SET;
+      for (unsigned int i = 0; i < DL_OBJECTS; ++i)
+	{
+	  const dl_object *o = &dl_obj[i];
+	  if ((o->kind != DL_NONE) && o->visible &&
+	      (o->box.x0 <= r->x1) && (o->box.x1 >= r->x0) &&
+	      (o->box.y0 <= r->y1) && (o->box.y1 >= r->y0))
+	    dl_render (o);
+	}
+    }
+  dl_n_dirty[w_page] = 0;
+
+  gdp_pen = save_pen;
+  gdp_clip = save_clip;
+
+  // Show the page just drawn, draw into the other one next time
+  write_io_reg (0x60, (pages & 0x0F) | (w_page << 4) | (r_page << 6));
+  gdp_set_pages (w_page, r_page);
+}
@@ -0,0 +1,48 @@
+/**
+ * gdp_dlist.h
+ *
+ * Retained display list for the GDP (GDPico64 extension)
+ *
+ * Copyright (C) 2024  Oliver Kayser-Herold
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef _NDRNKC_GDP_DLIST_
+#define _NDRNKC_GDP_DLIST_
+
+#include "pico/stdlib.h"
+
+#define DL_OBJECTS    64     // Number of objects
+#define DL_POOL_SIZE  8192   // Memory for the vectors and characters of all objects
+
+// Kinds of objects
+#define DL_NONE   0
+#define DL_STRIP  1
+#define DL_TEXT   2
+
+extern void init_dlist ();
+extern void dl_clear ();
+extern int dl_define (uint8_t id, uint8_t kind, unsigned int x, unsigned int y,
+		      unsigned int n, const uint8_t *data);
+extern void dl_move (uint8_t id, unsigned int x, unsigned int y);
+extern void dl_rmove (uint8_t id, int dx, int dy);
+extern void dl_show (uint8_t id, int visible);
+extern void dl_delete (uint8_t id);
+extern void dl_frame ();
+
+#endif
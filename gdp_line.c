@@ -30,36 +30,29 @@
 
 
 /****************************************************************************
- * Name: draw_line
+ * Name: line_projections
  *
  * Description:
- *   Draw a line following the Bresenham algorithm as also described
- *   in the EF9365 datasheet.
- *   TODO: Line patterns (i.e. dashed, pointed, etc.) are not implemented
- *   yet.
+ *   Determines the signed projections of a vector command on the x
+ *   and y axis as described in the EF9365 datasheet (from the DELTAX
+ *   and DELTAY registers or from the command itself).
  *
  * Input Parameters:
  *   linecode - Command for drawing the line. Interpreted according
  *              to the EF9365 datasheet.
+ *   dx       - Projection on the x axis, returned
+ *   dy       - Projection on the y axis, returned
  *
  * Returned Value:
  *   None
  *
  ****************************************************************************/
 
-void draw_line (unsigned char linecode)
+void line_projections (unsigned char linecode, int *dx, int *dy)
 {
-  unsigned int x_ref = read_io_reg(gdp_xmsb) * 256 + read_io_reg(gdp_xlsb),
-    y_ref = read_io_reg(gdp_ymsb) * 256 + read_io_reg(gdp_ylsb);
   int ef_dx,
-    ef_dy,
-    delta_x;
+    ef_dy;
   int x_sign, y_sign;
-  //  int D;
-  int y_stride,
-    two_dy,
-    two_dy_dx,
-    var_p;
   uint8_t gdp_dx = read_io_reg(gdp_deltax),
     gdp_dy = read_io_reg(gdp_deltay);
 
@@ -114,52 +107,229 @@ void draw_line (unsigned char linecode)
 	ef_dx = 0;
     }
 
-  // Normal mode
-  if (ef_dy > ef_dx)
+  *dx = x_sign ? -ef_dx : ef_dx;
+  *dy = y_sign ? -ef_dy : ef_dy;
+}
+
+/****************************************************************************
+ * Name: draw_line
+ *
+ * Description:
+ *   Draw a line following the Bresenham algorithm as also described
+ *   in the EF9365 datasheet.
+ *   TODO: Line patterns (i.e. dashed, pointed, etc.) are not implemented
+ *   yet.
+ *
+ * Input Parameters:
+ *   linecode - Command for drawing the line. Interpreted according
+ *              to the EF9365 datasheet.
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void draw_line (unsigned char linecode)
+{
+  int dx, dy;
+
+  line_projections (linecode, &dx, &dy);
+  draw_vector (dx, dy);
+}
+
+/****************************************************************************
+ * Name: clip_range
+ *
+ * Description:
+ *   Limits a range of step counts v to the steps for which the
+ *   coordinate p0 + s * v is within lo .. hi.
+ *
+ * Input Parameters:
+ *   p0     - Start coordinate
+ *   s      - Direction (1 or -1)
+ *   lo     - Lowest allowed coordinate
+ *   hi     - Highest allowed coordinate
+ *   v_lo   - Lowest step count, updated
+ *   v_hi   - Highest step count, updated
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void clip_range (int p0, int s, int lo, int hi, int *v_lo, int *v_hi)
+{
+  int a = (s > 0) ? lo - p0 : p0 - hi,
+    b = (s > 0) ? hi - p0 : p0 - lo;
+
+  if (a > *v_lo)
+    *v_lo = a;
+  if (b < *v_hi)
+    *v_hi = b;
+}
+
+/****************************************************************************
+ * Name: render_vector
+ *
+ * Description:
+ *   Draws a line from the given position by the given projections
+ *   following the Bresenham algorithm. The first pixel drawn is the one
+ *   next to the start position. In contrast to the EF9365 commands, the
+ *   projections are not limited to 8 bit.
+ *
+ *   The line is clipped analytically: After t steps along the major
+ *   axis, the Bresenham algorithm has made
+ *     c(t) = (2 * t * d_min + d_maj) / (2 * d_maj)    (integer division)
+ *   steps along the minor axis. Solving the clip rectangle for t gives
+ *   the first and last visible pixel. Only these pixels are visited,
+ *   without checking the bounds of each pixel.
+ *
+ * Input Parameters:
+ *   x_ref  - x coordinate of the start position
+ *   y_ref  - y coordinate of the start position
+ *   dx     - Projection on the x axis
+ *   dy     - Projection on the y axis
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void render_vector (int x_ref, int y_ref, int dx, int dy)
+{
+  int x_step = (dx < 0) ? -1 : 1,
+    y_step = (dy < 0) ? -1 : 1;
+  int ef_dx = dx * x_step,
+    ef_dy = dy * y_step;
+
+  // Major axis is the longer projection (x for equal projections)
+  int y_stride = (ef_dy > ef_dx);
+  int d_maj = y_stride ? ef_dy : ef_dx,
+    d_min = y_stride ? ef_dx : ef_dy;
+
+  // Visible steps t (1 .. d_maj) along the major axis
+  int t_lo = 1, t_hi = d_maj;
+  // Visible steps c (0 .. d_min) along the minor axis
+  int c_lo = 0, c_hi = d_min;
+
+  if (y_stride)
     {
-      y_stride = 1;
-      delta_x = ef_dy;
-      two_dy = ef_dx * 2;
-      two_dy_dx = (ef_dx - ef_dy) * 2;
-      var_p = 2 * ef_dx - ef_dy;
+      clip_range (y_ref, y_step, gdp_clip.y0, gdp_clip.y1, &t_lo, &t_hi);
+      clip_range (x_ref, x_step, gdp_clip.x0, gdp_clip.x1, &c_lo, &c_hi);
     }
   else
     {
-      y_stride = 0;
-      delta_x = ef_dx;
-      two_dy = ef_dy * 2;
-      two_dy_dx = (ef_dy - ef_dx) * 2;
-      var_p = 2 * ef_dy - ef_dx;      
+      clip_range (x_ref, x_step, gdp_clip.x0, gdp_clip.x1, &t_lo, &t_hi);
+      clip_range (y_ref, y_step, gdp_clip.y0, gdp_clip.y1, &c_lo, &c_hi);
     }
 
-  // Now draw the line
-  int i = delta_x;
+  // Translate the minor axis range into major steps (c(t) is monotonic)
+  if (c_lo > c_hi)
+    t_hi = 0;
+  else if (d_min > 0)
+    {
+      int64_t n;
+      if (c_lo > 0)
+	{
+	  // First t with c(t) >= c_lo
+	  n = 2 * (int64_t) d_maj * c_lo - d_maj;
+	  if ((n + 2 * d_min - 1) / (2 * d_min) > t_lo)
+	    t_lo = (n + 2 * d_min - 1) / (2 * d_min);
+	}
+      if (c_hi < d_min)
+	{
+	  // Last t with c(t) <= c_hi
+	  n = 2 * (int64_t) d_maj * (c_hi + 1) - d_maj;
+	  if ((n + 2 * d_min - 1) / (2 * d_min) - 1 < t_hi)
+	    t_hi = (n + 2 * d_min - 1) / (2 * d_min) - 1;
+	}
+    }
 
-  while (i-- > 0)
-    { 
-      if (y_stride)
-	y_ref += y_sign ? -1 : 1;
-      else
-	x_ref += x_sign ? -1 : 1;
+  if ((t_lo <= t_hi) && (gdp_pen != GDP_PEN_NONE))
+    {
+      // Position and decision variable after t_lo steps
+      int c = ((int64_t) 2 * t_lo * d_min + d_maj) / (2 * (int64_t) d_maj);
+      int var_p = 2 * ((int64_t) (t_lo + 1) * d_min - (int64_t) d_maj * c) - d_maj;
+      int x = x_ref + x_step * (y_stride ? c : t_lo),
+	y = y_ref + y_step * (y_stride ? t_lo : c);
 
-      if (var_p < 0)
-	var_p = var_p + two_dy;
-      else
+      // Pixel operation as mask: word = (word & ~(m & p_and)) ^ (m & p_xor)
+      uint32_t p_and = (gdp_pen == GDP_PEN_XOR) ? 0 : 0xFFFFFFFFu,
+	p_xor = (gdp_pen == GDP_PEN_CLEAR) ? 0 : 0xFFFFFFFFu;
+      uint32_t *w = &graphmem_write[(255 - y) * 16 + (x >> 5)];
+      uint32_t m = 1u << (31 - (x & 0x1F));
+      int w_stride = y_step * -16;   // Framebuffer is stored top down
+
+      for (int t = t_lo; ; ++t)
 	{
-	  if (y_stride)
-	    x_ref += x_sign ? -1 : 1;
+	  *w = (*w & ~(m & p_and)) ^ (m & p_xor);
+	  if (t == t_hi)
+	    break;
+
+	  // Step along the major axis, then possibly along the minor axis
+	  int step_min = (var_p >= 0);
+	  if (step_min)
+	    var_p += 2 * (d_min - d_maj);
 	  else
-	    y_ref += y_sign ? -1 : 1;
-	  var_p = var_p + two_dy_dx;
-	}
+	    var_p += 2 * d_min;
 
-      plot_pixel (x_ref, y_ref);
+	  if (y_stride || step_min)
+	    w += w_stride;
+	  if (!y_stride || step_min)
+	    {
+	      if (x_step > 0)
+		{
+		  m >>= 1;
+		  if (m == 0)
+		    {
+		      m = 0x80000000u;
+		      ++w;
+		    }
+		}
+	      else
+		{
+		  m <<= 1;
+		  if (m == 0)
+		    {
+		      m = 1;
+		      --w;
+		    }
+		}
+	    }
+	}
     }
+}
+
+/****************************************************************************
+ * Name: draw_vector
+ *
+ * Description:
+ *   Draws a line from the current position (X, Y registers) by the
+ *   given projections (see render_vector). Afterwards the position
+ *   registers are set to the end of the line.
+ *
+ * Input Parameters:
+ *   dx     - Projection on the x axis
+ *   dy     - Projection on the y axis
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void draw_vector (int dx, int dy)
+{
+  int x_ref = read_io_reg(gdp_xmsb) * 256 + read_io_reg(gdp_xlsb),
+    y_ref = read_io_reg(gdp_ymsb) * 256 + read_io_reg(gdp_ylsb);
+
+  render_vector (x_ref, y_ref, dx, dy);
+  ++gdp_stats.vectors;
 
   // Now set coordinate registers to new coordinates
+  x_ref += dx;
+  y_ref += dy;
   write_io_reg (gdp_xmsb, (x_ref >> 8) & 0xFF);
   write_io_reg (gdp_xlsb, x_ref & 0xFF);
   write_io_reg (gdp_ymsb, (y_ref >> 8) & 0xFF);
   write_io_reg (gdp_ylsb, y_ref & 0xFF);
 }
-
@@ -27,6 +27,9 @@
 
 #include "pico/stdlib.h"
 
+extern void line_projections (unsigned char linecode, int *dx, int *dy);
 extern void draw_line (unsigned char linecode);
+extern void render_vector (int x_ref, int y_ref, int dx, int dy);
+extern void draw_vector (int dx, int dy);
   
 #endif
@@ -0,0 +1,384 @@
+/**
+ * gdp_list.c
+ *
+ * Packed command list for the GDP (GDPico64 extension). Instead of
+ * loading the EF9365 registers and issuing one command at a time, the
+ * Z80 writes a byte coded command stream into the list port. Core1
+ * stores the bytes into a ring buffer (see stream_put in parport.S),
+ * which is executed in batches by the GDP task.
+ *
+ * Copyright (C) 2024  Oliver Kayser-Herold
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "par_bus.h"
+#include "gdp.h"
+#include "gdp_char.h"
+#include "gdp_line.h"
+#include "gdp_list.h"
+#include "gdp_dlist.h"
+
+
+static uint8_t gdp_list_buf[GDP_LIST_SIZE];
+
+io_stream_t gdp_list = { .mask = GDP_LIST_SIZE - 1, .buf = gdp_list_buf };
+
+// Byte of the ring at (free running) position p
+#define LIST_BYTE(p) (gdp_list_buf[(p) & (GDP_LIST_SIZE - 1)])
+
+// Vectors or characters of an object definition, copied out of the ring
+static uint8_t list_payload[510];
+
+
+/****************************************************************************
+ * Name: init_gdp_list
+ *
+ * Description:
+ *   Empties the command list ring. The first byte written by the Z80
+ *   will signal the GDP task.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void init_gdp_list ()
+{
+  gdp_list.head = 0;
+  gdp_list.tail = 0;
+  gdp_list.lost = 0;
+  gdp_list.wake = 1;
+}
+
+/****************************************************************************
+ * Name: list_cmd_len
+ *
+ * Description:
+ *   Determines the length of the command at the given position. For
+ *   commands with a count byte, the length can only be determined
+ *   when the count byte is available. In that case the length of
+ *   opcode and count is returned.
+ *
+ * Input Parameters:
+ *   p      - Position of the opcode
+ *   avail  - Number of bytes available from p on
+ *
+ * Returned Value:
+ *   Length of the command in bytes
+ *
+ ****************************************************************************/
+
+static unsigned int list_cmd_len (uint32_t p, uint32_t avail)
+{
+  switch (LIST_BYTE (p))
+    {
+    case GDPL_MOVE:
+    case GDPL_DRAW:
+      return (5);
+    case GDPL_RMOVE:
+    case GDPL_RDRAW:
+    case GDPL_REG:
+      return (3);
+    case GDPL_CMD:
+      return (2);
+    case GDPL_POLY:
+      return ((avail < 2) ? 2 : 2 + 2 * LIST_BYTE (p + 1));
+    case GDPL_TEXT:
+      return ((avail < 2) ? 2 : 2 + LIST_BYTE (p + 1));
+    case GDPL_OMOVE:
+      return (6);
+    case GDPL_ORMOVE:
+      return (4);
+    case GDPL_OSHOW:
+      return (3);
+    case GDPL_ODEL:
+      return (2);
+    case GDPL_OSTRIP:
+      return ((avail < 7) ? 7 : 7 + 2 * LIST_BYTE (p + 6));
+    case GDPL_OTEXT:
+      return ((avail < 7) ? 7 : 7 + LIST_BYTE (p + 6));
+    }
+
+  // NOP and unknown opcodes are skipped
+  return (1);
+}
+
+/****************************************************************************
+ * Name: set_pos
+ *
+ * Description:
+ *   Sets the position registers (X, Y) of the EF9365.
+ *
+ * Input Parameters:
+ *   x      - x coordinate
+ *   y      - y coordinate
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void set_pos (unsigned int x, unsigned int y)
+{
+  write_io_reg (gdp_xmsb, (x >> 8) & 0xFF);
+  write_io_reg (gdp_xlsb, x & 0xFF);
+  write_io_reg (gdp_ymsb, (y >> 8) & 0xFF);
+  write_io_reg (gdp_ylsb, y & 0xFF);
+}
+
+/****************************************************************************
+ * Name: list_hold
+ *
+ * Description:
+ *   Waits for the beam before a drawing command of the list, when the
+ *   Z80 draws on the shown page with GDPX_CTRL_SYNC (see gdp_beam_hold).
+ *   Determines the lines the command draws on only in that case.
+ *
+ * Input Parameters:
+ *   p      - Position of the opcode
+ *   x      - x coordinate of the current position
+ *   y      - y coordinate of the current position
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void list_hold (uint32_t p, unsigned int x, unsigned int y)
+{
+  int y0 = y,
+    y1 = y;
+  int yp = y;
+  unsigned int n;
+  gdp_text_attr attr;
+  gdp_rect box;
+
+  if ((graphmem_write != graphmem) ||
+      ((read_io_reg (gdpx_ctrl) & GDPX_CTRL_SYNC) == 0))
+    return;
+
+  switch (LIST_BYTE (p))
+    {
+    case GDPL_DRAW:
+      yp += (int16_t) (LIST_BYTE (p + 3) + 256 * LIST_BYTE (p + 4) - y);
+      break;
+    case GDPL_RDRAW:
+      yp += (int8_t) LIST_BYTE (p + 2);
+      break;
+    case GDPL_POLY:
+      n = LIST_BYTE (p + 1);
+      for (p += 2; n > 0; --n, p += 2)
+	{
+	  yp += (int8_t) LIST_BYTE (p + 1);
+	  if (yp < y0)
+	    y0 = yp;
+	  if (yp > y1)
+	    y1 = yp;
+	}
+      break;
+    case GDPL_TEXT:
+      n = LIST_BYTE (p + 1);
+      for (unsigned int i = 0; i < n; ++i)
+	list_payload[i] = LIST_BYTE (p + 2 + i);
+      get_text_attr (&attr);
+      text_box (list_payload, n, &attr, x, y, &box);
+      y0 = box.y0;
+      y1 = box.y1;
+      break;
+    case GDPL_CMD:
+      gdp_cmd_rows (LIST_BYTE (p + 1), &y0, &y1);
+      gdp_beam_hold (y0, y1);
+      return;
+    default:
+      return;
+    }
+
+  if (yp < y0)
+    y0 = yp;
+  if (yp > y1)
+    y1 = yp;
+  gdp_beam_hold (y0, y1);
+}
+
+/****************************************************************************
+ * Name: list_exec
+ *
+ * Description:
+ *   Executes one (complete) command of the list. Coordinates are
+ *   16 bit values like the EF9365 position registers, a line to an
+ *   absolute position therefore takes the shorter way modulo 65536.
+ *   The register command (GDPL_REG) sets the EF9365 register
+ *   GDP_BASE + r for r = 0x1 .. 0xF and the extension register
+ *   GDPX_BASE + r - 0x10 for the control, font configuration and clip
+ *   registers. Other register numbers are ignored. The object commands
+ *   (0x10 - 0x17) are passed on to the display list. Drawing commands
+ *   may wait for the beam first (see list_hold).
+ *
+ * Input Parameters:
+ *   p      - Position of the opcode
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void list_exec (uint32_t p)
+{
+  unsigned int x = read_io_reg(gdp_xmsb) * 256 + read_io_reg(gdp_xlsb),
+    y = read_io_reg(gdp_ymsb) * 256 + read_io_reg(gdp_ylsb);
+  unsigned int n;
+  uint8_t r, v;
+
+  list_hold (p, x, y);
+
+  switch (LIST_BYTE (p))
+    {
+    case GDPL_MOVE:
+      set_pos (LIST_BYTE (p + 1) + 256 * LIST_BYTE (p + 2),
+	       LIST_BYTE (p + 3) + 256 * LIST_BYTE (p + 4));
+      break;
+    case GDPL_DRAW:
+      draw_vector ((int16_t) (LIST_BYTE (p + 1) + 256 * LIST_BYTE (p + 2) - x),
+		   (int16_t) (LIST_BYTE (p + 3) + 256 * LIST_BYTE (p + 4) - y));
+      break;
+    case GDPL_RMOVE:
+      set_pos (x + (int8_t) LIST_BYTE (p + 1), y + (int8_t) LIST_BYTE (p + 2));
+      break;
+    case GDPL_RDRAW:
+      draw_vector ((int8_t) LIST_BYTE (p + 1), (int8_t) LIST_BYTE (p + 2));
+      break;
+    case GDPL_POLY:
+      n = LIST_BYTE (p + 1);
+      for (p += 2; n > 0; --n, p += 2)
+	draw_vector ((int8_t) LIST_BYTE (p), (int8_t) LIST_BYTE (p + 1));
+      break;
+    case GDPL_TEXT:
+      n = LIST_BYTE (p + 1);
+      for (p += 2; n > 0; --n, ++p)
+	draw_char (LIST_BYTE (p));
+      break;
+    case GDPL_REG:
+      r = LIST_BYTE (p + 1);
+      v = LIST_BYTE (p + 2);
+      if (r == 0x1)
+	post_io_reg (gdp_ctrl1, v);   // Also changed by core1 (gdp_sendcmd)
+      else if ((r >= 0x2) && (r <= 0xF))
+	write_io_reg (GDP_BASE + r, v);
+      else if ((r == 0x10) || (r == 0x14) || ((r >= 0x19) && (r <= 0x1E)))
+	write_io_reg (GDPX_BASE + r - 0x10, v);  // XCTRL, FCFG, clip rectangle
+      gdp_update_pen ();
+      gdp_update_clip ();
+      break;
+    case GDPL_CMD:
+      gdp_proc_command (LIST_BYTE (p + 1));
+      break;
+    case GDPL_OCLEAR:
+      dl_clear ();
+      break;
+    case GDPL_OSTRIP:
+    case GDPL_OTEXT:
+      n = LIST_BYTE (p + 6);
+      r = (LIST_BYTE (p) == GDPL_OSTRIP) ? DL_STRIP : DL_TEXT;
+      for (unsigned int i = 0; i < ((r == DL_STRIP) ? 2 * n : n); ++i)
+	list_payload[i] = LIST_BYTE (p + 7 + i);
+      dl_define (LIST_BYTE (p + 1), r,
+		 LIST_BYTE (p + 2) + 256 * LIST_BYTE (p + 3),
+		 LIST_BYTE (p + 4) + 256 * LIST_BYTE (p + 5), n, list_payload);
+      break;
+    case GDPL_OMOVE:
+      dl_move (LIST_BYTE (p + 1), LIST_BYTE (p + 2) + 256 * LIST_BYTE (p + 3),
+	       LIST_BYTE (p + 4) + 256 * LIST_BYTE (p + 5));
+      break;
+    case GDPL_ORMOVE:
+      dl_rmove (LIST_BYTE (p + 1), (int8_t) LIST_BYTE (p + 2),
+		(int8_t) LIST_BYTE (p + 3));
+      break;
+    case GDPL_OSHOW:
+      dl_show (LIST_BYTE (p + 1), LIST_BYTE (p + 2));
+      break;
+    case GDPL_ODEL:
+      dl_delete (LIST_BYTE (p + 1));
+      break;
+    case GDPL_OFRAME:
+      dl_frame ();
+      break;
+    }
+}
+
+/****************************************************************************
+ * Name: gdp_run_list
+ *
+ * Description:
+ *   Executes all complete commands in the command list ring. Each
+ *   command is removed from the ring after it has been executed, so an
+ *   empty ring means that the Z80 may use the EF9365 registers again
+ *   (a background fill is completed before).
+ *   When the ring is empty or the last command is incomplete, core1 is
+ *   asked to signal the GDP task (a bus event through bus_ring) as
+ *   soon as the missing bytes have arrived. The request is checked once more
+ *   after it has been placed, so bytes arriving in between are not
+ *   overlooked.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_run_list ()
+{
+  uint32_t tail = gdp_list.tail;
+  int first = 1;
+
+  while (1)
+    {
+      uint32_t avail = gdp_list.head - tail;
+      unsigned int len = (avail > 0) ? list_cmd_len (tail, avail) : 1;
+
+      if (len > avail)
+	{
+	  gdp_list.wake = tail + len;
+	  if (gdp_list.head - tail < len)
+	    break;
+	  continue;
+	}
+
+      // Pixel operation and clip rectangle are taken from the registers
+      // at the start of a batch
+      if (first)
+	{
+	  gdp_update_pen ();
+	  gdp_update_clip ();
+	  first = 0;
+	}
+
+      list_exec (tail);
+      tail += len;
+      gdp_fill_wait ();
+      gdp_list.tail = tail;
+      gdp_stats.list_bytes += len;
+    }
+}
@@ -0,0 +1,62 @@
+/**
+ * gdp_list.h
+ *
+ * Packed command list for the GDP (GDPico64 extension)
+ *
+ * Copyright (C) 2024  Oliver Kayser-Herold
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef _NDRNKC_GDP_LIST_
+#define _NDRNKC_GDP_LIST_
+
+#include "pico/stdlib.h"
+#include "io_dev.h"
+
+// Size of the command list ring (power of 2)
+#define GDP_LIST_SIZE 4096
+
+// Ring between the list port (core1, stream_put in parport.S) and the
+// GDP task. The tail is advanced after executing a command.
+extern io_stream_t gdp_list;
+
+// Opcodes of the command list
+#define GDPL_NOP    0x00   // No operation
+#define GDPL_MOVE   0x01   // x, y (16 bit each, low byte first): Set position
+#define GDPL_DRAW   0x02   // x, y (16 bit each, low byte first): Line to x, y
+#define GDPL_RMOVE  0x03   // dx, dy (signed 8 bit): Move relative
+#define GDPL_RDRAW  0x04   // dx, dy (signed 8 bit): Line relative
+#define GDPL_POLY   0x05   // n, n * (dx, dy): Polyline of relative lines
+#define GDPL_TEXT   0x06   // n, n * character: Text run
+#define GDPL_REG    0x07   // r, value: Set register (see list_exec)
+#define GDPL_CMD    0x08   // c: Execute EF9365 command
+
+// Opcodes of the retained display list (see gdp_dlist.c)
+#define GDPL_OCLEAR 0x10   // Delete all objects
+#define GDPL_OSTRIP 0x11   // id, x, y, n, n * (dx, dy): Define line strip object
+#define GDPL_OTEXT  0x12   // id, x, y, n, n * character: Define text object
+#define GDPL_OMOVE  0x13   // id, x, y: Move object
+#define GDPL_ORMOVE 0x14   // id, dx, dy: Move object relative
+#define GDPL_OSHOW  0x15   // id, on: Show (on != 0) or hide object
+#define GDPL_ODEL   0x16   // id: Delete object
+#define GDPL_OFRAME 0x17   // Redraw changed areas and flip pages
+
+extern void init_gdp_list ();
+extern void gdp_run_list ();
+
+#endif
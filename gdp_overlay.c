@@ -0,0 +1,202 @@
+/**
+ * gdp_overlay.c
+ *
+ * Text overlay shown on top of the GDP pages (on-screen monitor). The
+ * overlay has its own text buffer and uses the built-in character set,
+ * so it neither depends on nor changes the graphics memory and the
+ * font RAM of the Z80. The text is rendered into a separate bitmap,
+ * which replaces the lower lines of the shown page at scanout (see
+ * gdp_data_dma_handler).
+ *
+ * Copyright (C) 2024  Oliver Kayser-Herold
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "gdp.h"
+#include "gdp_char.h"
+#include "gdp_overlay.h"
+
+
+volatile uint8_t ovl_visible = 0;
+
+// Lines of the overlay in framebuffer layout (bit 31 is the leftmost pixel)
+uint32_t ovl_bitmap[OVL_LINES * 16];
+
+// Text of the overlay and rows that have changed since the last refresh
+static char ovl_text[OVL_ROWS][OVL_COLS];
+static uint8_t ovl_dirty[OVL_ROWS];
+
+
+/****************************************************************************
+ * Name: ovl_render_row
+ *
+ * Description:
+ *   Renders one text row into the overlay bitmap. Each character cell
+ *   is 8 x 10 pixels, the 5 x 8 glyph of the built-in character set is
+ *   placed at its upper left with one blank line above.
+ *
+ * Input Parameters:
+ *   row    - Text row
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void ovl_render_row (unsigned int row)
+{
+  uint32_t *line = &ovl_bitmap[(2 + 10 * row) * 16];
+
+  memset (line, 0, 10 * 16 * sizeof (uint32_t));
+  for (unsigned int c = 0; c < OVL_COLS; ++c)
+    {
+      unsigned char a = ovl_text[row][c];
+      if ((a <= 0x20) || (a > 0x80))
+	continue;
+
+      const unsigned char *data = charset[a - 0x20];
+      unsigned int shift = 24 - 8 * (c & 0x3);
+      for (unsigned int j = 0; j < 8; ++j)
+	{
+	  // Column data has the upper row in bit 0
+	  uint32_t bits = 0;
+	  for (unsigned int i = 0; i < 5; ++i)
+	    if (data[i] & (1 << j))
+	      bits |= 0x80 >> i;
+	  line[(1 + j) * 16 + (c >> 2)] |= bits << shift;
+	}
+    }
+}
+
+/****************************************************************************
+ * Name: ovl_show
+ *
+ * Description:
+ *   Shows or hides the overlay. The overlay is brought up to date
+ *   before it is shown.
+ *
+ * Input Parameters:
+ *   on     - Non-zero to show the overlay
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void ovl_show (int on)
+{
+  if (on)
+    {
+      // Separator line at the top
+      for (unsigned int i = 0; i < 16; ++i)
+	ovl_bitmap[i] = 0xFFFFFFFFu;
+      ovl_refresh ();
+    }
+  ovl_visible = on ? 1 : 0;
+}
+
+/****************************************************************************
+ * Name: ovl_clear
+ *
+ * Description:
+ *   Clears the text of the overlay.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void ovl_clear ()
+{
+  memset (ovl_text, ' ', sizeof (ovl_text));
+  memset (ovl_dirty, 1, sizeof (ovl_dirty));
+}
+
+/****************************************************************************
+ * Name: ovl_print
+ *
+ * Description:
+ *   Replaces one text row of the overlay (printf style). Text beyond
+ *   OVL_COLS characters is cut off. The bitmap is updated by
+ *   ovl_refresh.
+ *
+ * Input Parameters:
+ *   row    - Text row (0 is the upper row)
+ *   fmt    - Format string, followed by the arguments
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void ovl_print (unsigned int row, const char *fmt, ...)
+{
+  char buf[OVL_COLS + 1];
+  va_list args;
+  int n;
+
+  if (row >= OVL_ROWS)
+    return;
+
+  va_start (args, fmt);
+  n = vsnprintf (buf, sizeof (buf), fmt, args);
+  va_end (args);
+  if (n < 0)
+    n = 0;
+  if (n > OVL_COLS)
+    n = OVL_COLS;
+
+  memset (buf + n, ' ', OVL_COLS - n);
+  if (memcmp (ovl_text[row], buf, OVL_COLS))
+    {
+      memcpy (ovl_text[row], buf, OVL_COLS);
+      ovl_dirty[row] = 1;
+    }
+}
+
+/****************************************************************************
+ * Name: ovl_refresh
+ *
+ * Description:
+ *   Renders the text rows that have changed into the overlay bitmap.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void ovl_refresh ()
+{
+  for (unsigned int row = 0; row < OVL_ROWS; ++row)
+    if (ovl_dirty[row])
+      {
+	ovl_render_row (row);
+	ovl_dirty[row] = 0;
+      }
+}
@@ -0,0 +1,44 @@
+/**
+ * gdp_overlay.h
+ *
+ * Text overlay shown on top of the GDP pages (on-screen monitor)
+ *
+ * Copyright (C) 2024  Oliver Kayser-Herold
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef _NDRNKC_GDP_OVERLAY_
+#define _NDRNKC_GDP_OVERLAY_
+
+#include "pico/stdlib.h"
+
+#define OVL_COLS   64                       // Characters per text row (8 pixels each)
+#define OVL_ROWS   8                        // Text rows (10 lines each)
+#define OVL_LINES  (2 + 10 * OVL_ROWS)      // Framebuffer lines covered at the bottom
+#define OVL_TOP    (256 - OVL_LINES)        // First covered line (from the top)
+
+// Read by the scanout interrupt
+extern volatile uint8_t ovl_visible;
+extern uint32_t ovl_bitmap[OVL_LINES * 16];
+
+extern void ovl_show (int on);
+extern void ovl_clear ();
+extern void ovl_print (unsigned int row, const char *fmt, ...);
+extern void ovl_refresh ();
+
+#endif
@@ -0,0 +1,299 @@
+/**
+ * gdp_worker.c
+ *
+ * Render work executed by core1 while the Z80 bus is idle. Core1
+ * spends most of its time polling the PIO FIFOs. When the worker is
+ * enabled, the GDP task on core0 queues horizontal spans (of solid
+ * rectangles) instead of filling them itself, and core1 fills them in
+ * slices of at most GDP_SLICE_WORDS words between two polls. A bus
+ * cycle arriving during a slice is thus delayed by at most one slice.
+ *
+ * Copyright (C) 2024  Oliver Kayser-Herold
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "hardware/structs/systick.h"
+
+#include "par_bus.h"
+#include "gdp.h"
+#include "gdp_worker.h"
+
+
+// Span of one framebuffer line, as in fill_span
+typedef struct gdp_span_s
+{
+  uint32_t *row;
+  uint32_t m0, m1;   // Masks of the first and the last word
+  uint8_t w0, w1;    // First and last word (inclusive)
+  uint8_t pen;       // Pixel operation
+} gdp_span;
+
+// Queue from the GDP task (core0) to core1. Head and tail are free
+// running counters.
+typedef struct gdp_span_ring_s
+{
+  volatile uint32_t head;   // Written by core0 after storing a span
+  volatile uint32_t tail;   // Written by core1 after filling a span
+  gdp_span job[GDP_SPAN_JOBS];
+} gdp_span_ring;
+
+static gdp_span_ring span_ring;
+static int slice_w = -1;    // Next word of the current span (core1), -1: start
+
+gdp_worker_stats_t gdp_worker_stats;
+uint8_t gdp_worker_enabled = 0;
+
+
+/****************************************************************************
+ * Name: gdp_worker_slice
+ *
+ * Description:
+ *   Idle hook of core1. Fills at most GDP_SLICE_WORDS words of the
+ *   oldest queued span and removes the span from the queue when it is
+ *   complete. The duration of the slice is measured with the SysTick
+ *   timer of core1 (processor cycles). Placed in scratch X like the
+ *   rest of the bus handling, so it never waits for the flash.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void __scratch_x(__STRING(gdp_worker_slice)) gdp_worker_slice ()
+{
+  uint32_t t_start = systick_hw->cvr;
+  uint32_t tail = span_ring.tail;
+
+  if (tail == span_ring.head)
+    return;
+
+  gdp_span *s = &span_ring.job[tail & (GDP_SPAN_JOBS - 1)];
+  int w = (slice_w < 0) ? s->w0 : slice_w,
+    w_end = w + GDP_SLICE_WORDS - 1;
+  if (w_end > s->w1)
+    w_end = s->w1;
+
+  gdp_worker_stats.words += w_end - w + 1;
+  for (; w <= w_end; ++w)
+    {
+      uint32_t m = 0xFFFFFFFFu;
+      if (w == s->w0)
+	m &= s->m0;
+      if (w == s->w1)
+	m &= s->m1;
+
+      if (s->pen == GDP_PEN_SET)
+	s->row[w] |= m;
+      else if (s->pen == GDP_PEN_CLEAR)
+	s->row[w] &= ~m;
+      else
+	s->row[w] ^= m;
+    }
+
+  if (w > s->w1)
+    {
+      slice_w = -1;
+      __dmb ();
+      span_ring.tail = tail + 1;
+    }
+  else
+    slice_w = w;
+
+  // SysTick counts down
+  uint32_t cycles = (t_start - systick_hw->cvr) & 0xFFFFFF;
+  if (cycles > gdp_worker_stats.max_cycles)
+    gdp_worker_stats.max_cycles = cycles;
+  ++gdp_worker_stats.slices;
+}
+
+/****************************************************************************
+ * Name: gdp_worker_busy
+ *
+ * Description:
+ *   Checks whether core1 still has spans to fill.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   true while spans are queued
+ *
+ ****************************************************************************/
+
+bool gdp_worker_busy ()
+{
+  return (span_ring.head != span_ring.tail);
+}
+
+/****************************************************************************
+ * Name: gdp_worker_enable
+ *
+ * Description:
+ *   Switches the core1 worker on or off. When it is switched off, the
+ *   queued spans are filled first.
+ *
+ * Input Parameters:
+ *   on     - Non-zero to let core1 fill the spans of rectangles
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_worker_enable (int on)
+{
+  if (on)
+    {
+      core1_idle = gdp_worker_slice;
+      gdp_worker_enabled = 1;
+    }
+  else
+    {
+      gdp_worker_enabled = 0;
+      while (gdp_worker_busy ())
+	taskYIELD ();
+      core1_idle = NULL;
+    }
+}
+
+/****************************************************************************
+ * Name: gdp_worker_span
+ *
+ * Description:
+ *   Queues a horizontal run of pixels for core1, with the current
+ *   pixel operation and clipped like fill_span. Waits when the queue
+ *   is full.
+ *
+ * Input Parameters:
+ *   x0     - x coordinate of the first pixel
+ *   x1     - x coordinate of the last pixel (inclusive)
+ *   y      - y coordinate of the line
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_worker_span (int x0, int x1, int y)
+{
+  if ((y < gdp_clip.y0) || (y > gdp_clip.y1) || (gdp_pen == GDP_PEN_NONE))
+    return;
+  if (x0 < gdp_clip.x0)
+    x0 = gdp_clip.x0;
+  if (x1 > gdp_clip.x1)
+    x1 = gdp_clip.x1;
+  if (x0 > x1)
+    return;
+
+  uint32_t head = span_ring.head;
+  while (head - span_ring.tail >= GDP_SPAN_JOBS)
+    taskYIELD ();
+
+  gdp_span *s = &span_ring.job[head & (GDP_SPAN_JOBS - 1)];
+  s->row = &graphmem_write[(255 - y) * 16];
+  s->w0 = x0 >> 5;
+  s->w1 = x1 >> 5;
+  // Leftmost pixel is in bit 31 of each word
+  s->m0 = 0xFFFFFFFFu >> (x0 & 0x1F);
+  s->m1 = 0xFFFFFFFFu << (31 - (x1 & 0x1F));
+  s->pen = gdp_pen;
+
+  __dmb ();
+  span_ring.head = head + 1;
+}
+
+// Result of the rectangle benchmark (see gdp_worker_bench)
+typedef struct gdp_bench_s {
+  uint32_t t_issue;   // Time until fill_rect has returned for all rectangles
+  uint32_t t_done;    // Time until all rectangles are drawn
+} gdp_bench_t;
+
+/****************************************************************************
+ * Name: worker_bench
+ *
+ * Description:
+ *   Draws a fixed set of rectangles in XOR mode (twice, so the picture
+ *   is unchanged) with the current worker setting. Measures the time
+ *   core0 needs to issue them and the time until they are complete.
+ *   Runs in the GDP task (see gdp_worker_bench).
+ *
+ * Input Parameters:
+ *   arg    - Result (gdp_bench_t), returned
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void worker_bench (void *arg)
+{
+  gdp_bench_t *res = (gdp_bench_t *) arg;
+  uint8_t save_pen = gdp_pen;
+  gdp_rect save_clip = gdp_clip;
+  uint32_t t_start;
+
+  gdp_fill_wait ();
+  gdp_pen = GDP_PEN_XOR;
+  gdp_clip = (gdp_rect) {0, 0, 511, 255};
+
+  t_start = time_us_32 ();
+  for (unsigned int k = 0; k < 2; ++k)
+    for (unsigned int i = 0; i < 64; ++i)
+      {
+	int x = (i * 37) & 0xFF,
+	  y = (i * 23) & 0x7F;
+	fill_rect (x, y, x + 200, y + 100);
+      }
+  res->t_issue = time_us_32 () - t_start;
+  gdp_fill_wait ();
+  res->t_done = time_us_32 () - t_start;
+
+  gdp_pen = save_pen;
+  gdp_clip = save_clip;
+}
+
+/****************************************************************************
+ * Name: gdp_worker_bench
+ *
+ * Description:
+ *   Runs the rectangle benchmark (see worker_bench) in the GDP task
+ *   between two commands, so it does not interfere with the pen and
+ *   the clip rectangle of a running command.
+ *
+ * Input Parameters:
+ *   t_issue - Time in us until fill_rect has returned for all rectangles
+ *   t_done  - Time in us until all rectangles are drawn
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void gdp_worker_bench (uint32_t *t_issue, uint32_t *t_done)
+{
+  gdp_bench_t res;
+
+  gdp_call (worker_bench, &res);
+  *t_issue = res.t_issue;
+  *t_done = res.t_done;
+}
@@ -0,0 +1,49 @@
+/**
+ * gdp_worker.h
+ *
+ * Render work executed by core1 while the Z80 bus is idle
+ *
+ * Copyright (C) 2024  Oliver Kayser-Herold
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef _NDRNKC_GDP_WORKER_
+#define _NDRNKC_GDP_WORKER_
+
+#include "pico/stdlib.h"
+
+#define GDP_SPAN_JOBS    64   // Spans queued for core1 (power of 2)
+#define GDP_SLICE_WORDS  4    // Framebuffer words per slice
+
+// Counters of core1 (written by core1 only)
+typedef struct gdp_worker_stats_s {
+  volatile uint32_t words;        // Framebuffer words written
+  volatile uint32_t slices;       // Slices executed
+  volatile uint32_t max_cycles;   // Longest slice in processor cycles
+} gdp_worker_stats_t;
+
+extern gdp_worker_stats_t gdp_worker_stats;
+extern uint8_t gdp_worker_enabled;
+
+extern void gdp_worker_enable (int on);
+extern void gdp_worker_span (int x0, int x1, int y);
+extern bool gdp_worker_busy ();
+extern void gdp_worker_slice ();
+extern void gdp_worker_bench (uint32_t *t_issue, uint32_t *t_done);
+
+#endif
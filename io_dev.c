@@ -0,0 +1,217 @@
+/**
+ * io_dev.c
+ *
+ * Table of the devices on the Z80 IO bus
+ *
+ * Copyright (C) 2024  Oliver Kayser-Herold
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "io_dev.h"
+#include "gdp.h"
+#include "gdp_list.h"
+#include "cas.h"
+#include "key.h"
+#include "mem.h"
+
+// Defined in:
+// parport.S
+extern void ioregread (void);
+extern void ioregwrite (void);
+extern void noaction (void);
+extern void ser_sendflag (void);
+extern void stream_put (void);
+
+
+// Serial card
+static const io_port_t ser_ports[] = {
+  { 0xF0, 0xF0, IO_HANDLER, 0, ser_sendflag, ioregread },
+  { 0xF1, 0xF1, IO_REG, 0 }
+};
+
+// Page register
+static const io_port_t page_ports[] = {
+  { 0x60, 0x60, IO_HANDLER, 0, gdp_setpages, ioregread }
+};
+
+// GDP64 register set
+static const io_port_t gdp_ports[] = {
+  { gdp_status, gdp_status, IO_HANDLER, 0xF4, gdp_sendcmd, ioregread },  // Start with "non busy"
+  { gdp_ctrl1, gdp_csize, IO_REG, 0 },
+  { GDP_BASE + 4, GDP_BASE + 4, IO_RO, 0 },
+  { gdp_deltax, gdp_deltax, IO_REG, 0 },
+  { GDP_BASE + 6, GDP_BASE + 6, IO_RO, 0 },
+  { gdp_deltay, gdp_ylsb, IO_REG, 0 }
+};
+
+// GDPico64 extension registers
+static const io_port_t gdpx_ports[] = {
+  { gdpx_ctrl, gdpx_ctrl, IO_REG, 0 },
+  { gdpx_adrl, gdpx_adrl, IO_HANDLER, 0, gdpx_setadrl, ioregread },
+  { gdpx_adrh, gdpx_adrh, IO_HANDLER, 0, gdpx_setadrh, ioregread },
+  { gdpx_data, gdpx_data, IO_HANDLER, 0, gdpx_putdata, gdpx_getdata },
+  { gdpx_fcfg, gdpx_fcfg, IO_REG, 0x04 },  // Font RAM glyphs 5x8
+  { gdpx_fadrl, gdpx_fadrh, IO_REG, 0 },
+  { gdpx_fdata, gdpx_fdata, IO_HANDLER, 0, gdpx_putfont, NULL },
+  { gdpx_list, gdpx_list, IO_STREAM, 0, NULL, gdpx_getlist, &gdp_list },
+  { gdpx_clipx0l, gdpx_clipx0h, IO_REG, 0 },
+  { gdpx_clipx1l, gdpx_clipx1l, IO_REG, 0xFF },  // Clip rectangle is the whole screen
+  { gdpx_clipx1h, gdpx_clipx1h, IO_REG, 0x01 },
+  { gdpx_clipy0, gdpx_clipy0, IO_REG, 0 },
+  { gdpx_clipy1, gdpx_clipy1, IO_REG, 0xFF }
+};
+
+// Keyboard
+static const io_port_t key_ports[] = {
+  { 0x68, 0x68, IO_RO, 0x80 },  // Start with "no key pending"
+  { 0x69, 0x69, IO_HANDLER, 0, NULL, key_setflag }
+};
+
+// CAS
+static const io_port_t cas_ports[] = {
+  { 0xCA, 0xCA, IO_RO, 0x02 },  // Start with "transmit buffer empty"
+  { 0xCB, 0xCB, IO_HANDLER, 0, cas_getflag, cas_setflag }
+};
+
+// Memory window
+static const io_port_t mem_ports[] = {
+  { mem_ctrl, mem_ctrl, IO_REG, 0 },
+  { mem_adrl, mem_adrl, IO_HANDLER, 0, mem_setadrl, ioregread },
+  { mem_adrh, mem_adrh, IO_HANDLER, 0, mem_setadrh, ioregread },
+  { mem_data, mem_data, IO_HANDLER, 0, mem_putdata, mem_getdata }
+};
+
+#define IO_PORTS(p) p, sizeof (p) / sizeof (p[0])
+
+const io_device_t io_devices[] = {
+  { "SER", IO_PORTS (ser_ports), NULL },
+  { "PAGE", IO_PORTS (page_ports), &gdp_page_events },
+  { "GDP", IO_PORTS (gdp_ports), &gdp_events },
+  { "GDPX", IO_PORTS (gdpx_ports), &gdp_events },   // Command list port
+  { "KEY", IO_PORTS (key_ports), NULL },
+  { "CAS", IO_PORTS (cas_ports), &cas_events },
+  { "MEM", IO_PORTS (mem_ports), NULL }
+};
+
+const unsigned int io_n_devices = sizeof (io_devices) / sizeof (io_devices[0]);
+
+StreamBufferHandle_t io_route[256];
+io_stream_t *io_stream[256];
+
+
+/****************************************************************************
+ * Name: io_build
+ *
+ * Description:
+ *   Fills the dispatch tables of core1, the initial register values and
+ *   the routing of bus events from a device table. Ports not claimed by
+ *   a device are ignored on write and not driven on read. A port that
+ *   is claimed twice is reported and keeps the first claim.
+ *   Behind the 256 registers, the read mode (IO_RD_xxx) of each port is
+ *   stored. Ports that are read through ioregread need no read handler.
+ *
+ * Input Parameters:
+ *   devs     - Device table
+ *   n_devs   - Number of devices in the table
+ *   regset   - Write handlers (256 entries), filled
+ *   regget   - Read handlers (256 entries, 0: none), filled
+ *   mem      - Register bank (512 bytes), filled with the initial
+ *              values and the read modes
+ *   route    - Stream buffer for the events of each port, filled
+ *   stream   - Ring of each streaming port, filled
+ *
+ * Returned Value:
+ *   Number of conflicting port claims
+ *
+ ****************************************************************************/
+
+int io_build (const io_device_t *devs, unsigned int n_devs,
+	      uint32_t *regset, uint32_t *regget, uint8_t *mem,
+	      StreamBufferHandle_t *route, io_stream_t **stream)
+{
+  uint8_t owner[256];   // Device + 1 (0: free)
+  int errors = 0;
+
+  memset (owner, 0, sizeof (owner));
+  for (unsigned int i = 0; i < 256; ++i)
+    {
+      regset[i] = (uint32_t) &noaction;
+      regget[i] = 0;   // No data is put on bus!
+      mem[i] = 0;
+      route[i] = NULL;
+      stream[i] = NULL;
+    }
+
+  for (unsigned int d = 0; d < n_devs; ++d)
+    for (unsigned int p = 0; p < devs[d].n_ports; ++p)
+      {
+	const io_port_t *port = &devs[d].ports[p];
+
+	for (unsigned int i = port->first; i <= port->last; ++i)
+	  {
+	    if (owner[i] != 0)
+	      {
+		printf ("IO port %02x of %s already used by %s\n", i,
+			devs[d].name, devs[owner[i] - 1].name);
+		++errors;
+		continue;
+	      }
+	    owner[i] = d + 1;
+
+	    switch (port->type)
+	      {
+	      case IO_REG :
+		regset[i] = (uint32_t) &ioregwrite;
+		regget[i] = (uint32_t) &ioregread;
+		break;
+	      case IO_RO :
+		regget[i] = (uint32_t) &ioregread;
+		break;
+	      case IO_STREAM :
+		regset[i] = (uint32_t) &stream_put;
+		stream[i] = port->stream;
+		if (port->get != NULL)
+		  regget[i] = (uint32_t) port->get;
+		break;
+	      default :
+		if (port->set != NULL)
+		  regset[i] = (uint32_t) port->set;
+		if (port->get != NULL)
+		  regget[i] = (uint32_t) port->get;
+		break;
+	      }
+	    mem[i] = port->init;
+	    if (devs[d].events != NULL)
+	      route[i] = *devs[d].events;
+	  }
+      }
+
+  for (unsigned int i = 0; i < 256; ++i)
+    if (regget[i] == 0)
+      mem[256 + i] = IO_RD_NONE;
+    else if (regget[i] == (uint32_t) &ioregread)
+      mem[256 + i] = IO_RD_REG;
+    else
+      mem[256 + i] = IO_RD_CORE1;
+
+  return (errors);
+}
@@ -0,0 +1,94 @@
+/**
+ * io_dev.h
+ *
+ * Table of the devices on the Z80 IO bus
+ *
+ * Copyright (C) 2024  Oliver Kayser-Herold
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+
+#ifndef _NDRNKC_IO_DEV_
+#define _NDRNKC_IO_DEV_
+
+#include <stdint.h>
+#include <FreeRTOS.h>
+#include <stream_buffer.h>
+
+// Treatment of a port by core1
+#define IO_REG      0   // Plain register, read and written by the Z80
+#define IO_RO       1   // Plain register, only read by the Z80
+#define IO_HANDLER  2   // Handlers of the port entry (flags, events)
+#define IO_STREAM   3   // Writes are appended to the ring of the port entry
+
+// Read mode of a port (behind the registers in the register bank)
+#define IO_RD_NONE  0   // Bus not driven
+#define IO_RD_REG   1   // Register value, served by DMA without core1
+#define IO_RD_CORE1 2   // Read handler on core1
+
+// Ring behind a streaming port (IO_STREAM). Core1 appends the bytes
+// written to the port (stream_put in parport.S) and signals the device
+// task through a bus event when head reaches wake. Head and tail are
+// free running counters, the buffer index is the counter & mask. The
+// field offsets are used in parport.S.
+typedef struct io_stream_s
+{
+  volatile uint32_t head;   // Written by core1 after storing a byte
+  volatile uint32_t tail;   // Written by the device task after consuming bytes
+  volatile uint32_t wake;   // Core1 signals the device task when head reaches this value
+  volatile uint32_t lost;   // Bytes dropped because the ring was full
+  uint32_t mask;            // Size of buf - 1 (size is a power of 2)
+  uint8_t *buf;
+} io_stream_t;
+
+// Range of ports with the same treatment
+typedef struct io_port_s
+{
+  uint8_t first;          // First port
+  uint8_t last;           // Last port (inclusive)
+  uint8_t type;           // IO_REG, IO_RO, IO_HANDLER or IO_STREAM
+  uint8_t init;           // Initial register value
+  void (*set) (void);     // Write handler (IO_HANDLER, NULL: ignored)
+  void (*get) (void);     // Read handler (IO_HANDLER, IO_STREAM, NULL: bus not driven)
+  io_stream_t *stream;    // Ring for the written bytes (IO_STREAM)
+} io_port_t;
+
+// Device on the bus. Events of all its ports that are passed to core0
+// (see bus_event in parport.S) go to the stream buffer of its task.
+typedef struct io_device_s
+{
+  const char *name;
+  const io_port_t *ports;
+  unsigned int n_ports;
+  StreamBufferHandle_t *events;   // Stream buffer of the task (NULL: none)
+} io_device_t;
+
+extern const io_device_t io_devices[];
+extern const unsigned int io_n_devices;
+
+// Stream buffer for the events of each port (NULL: events are ignored)
+extern StreamBufferHandle_t io_route[256];
+
+// Ring of each streaming port (NULL: other ports)
+extern io_stream_t *io_stream[256];
+
+extern int io_build (const io_device_t *devs, unsigned int n_devs,
+		     uint32_t *regset, uint32_t *regget, uint8_t *mem,
+		     StreamBufferHandle_t *route, io_stream_t **stream);
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * mem.c
+ *
+ * Memory window: a RAM/ROM image in the Pico's SRAM, accessed by the
+ * Z80 through an address register and an auto-incrementing data port.
+ *
+ * Copyright (C) 2024  Oliver Kayser-Herold
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "par_bus.h"
+#include "xmodem_pico.h"
+#include "mem.h"
+
+
+uint8_t mem_image[MEM_SIZE];
+
+
+/****************************************************************************
+ * Name: mem_load
+ *
+ * Description:
+ *   Receives an image into the memory window via XModem. The remainder
+ *   of the window is cleared. Afterwards the address register is set
+ *   to 0, so the Z80 reads the image from its start. The Z80 should not
+ *   use the window during the transfer.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void mem_load ()
+{
+  int xm_rc;
+
+  memset (mem_image, 0, sizeof (mem_image));
+  xm_rc = xmodemReceive (mem_image, sizeof (mem_image));
+  if (xm_rc < 0)
+    printf ("XModem Transfer Error!\n");
+  else
+    printf ("XModem Received %i\n", xm_rc);
+
+  post_io_reg (mem_adrl, 0);
+  post_io_reg (mem_adrh, 0);
+  post_io_reg (mem_data, mem_image[0]);
+}
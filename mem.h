@@ -0,0 +1,56 @@
+/**
+ * mem.h
+ *
+ * Memory window: a RAM/ROM image in the Pico's SRAM, accessed by the
+ * Z80 through an address register and an auto-incrementing data port.
+ *
+ * Copyright (C) 2024  Oliver Kayser-Herold
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef _NDRNKC_MEM_
+#define _NDRNKC_MEM_
+
+#include "pico/stdlib.h"
+
+// Size of the image (power of 2, must match MEM_BITS in mem_io.S)
+#define MEM_SIZE 0x8000
+
+// IO ports of the memory window
+#define MEM_BASE 0xB0
+
+#define mem_ctrl   (MEM_BASE)
+#define mem_adrl   (MEM_BASE + 1)
+#define mem_adrh   (MEM_BASE + 2)
+#define mem_data   (MEM_BASE + 3)
+
+// Bits of MCTRL
+#define MEM_CTRL_WP 0x01   // Write protected (ROM)
+
+// Image served through the data port
+extern uint8_t mem_image[MEM_SIZE];
+
+// IO handling in assembler
+extern void mem_setadrl (void);
+extern void mem_setadrh (void);
+extern void mem_putdata (void);
+extern void mem_getdata (void);
+
+extern void mem_load ();
+
+#endif
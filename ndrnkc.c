@@ -27,6 +27,7 @@
 #include <FreeRTOS.h>
 #include <task.h>
 #include <queue.h>
+#include <stream_buffer.h>
 
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
@@ -34,27 +35,51 @@
 #include "hardware/interp.h"
 #include "hardware/dma.h"
 #include "hardware/structs/sio.h"
+#include "hardware/clocks.h"
 #include "gdp.h"
+#include "gdp_list.h"
+#include "gdp_char.h"
+#include "gdp_worker.h"
+#include "gdp_overlay.h"
 #include "ps2key.h"
 #include "cas.h"
 #include "key.h"
+#include "mem.h"
 #include "xmodem_pico.h"
 #include "par_bus.h"
+#include "io_dev.h"
 #include "stdio_dev.h"
 #include "gpio_def.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 
 uint8_t z80_io_buf[256];
 
-typedef struct iodev_list_s
+// Events collected for one device task in the FIFO interrupt. Up to
+// BUS_BATCHES devices per round, further devices wait for the next round.
+#define BUS_BATCHES 4
+typedef struct bus_batch_s
 {
-  QueueHandle_t queue;
-  uint32_t (*iodev_funct)(uint8_t reg, uint8_t data);
-} iodev_list;
+  StreamBufferHandle_t events;
+  uint32_t room;       // Events that fit into the stream buffer (at most PBUS_EVENTS)
+  uint32_t n;
+  uint32_t ev[PBUS_EVENTS];
+} bus_batch;
 
-iodev_list simdev[16];
+static bus_batch batches[BUS_BATCHES];
+
+// Statistics of the FIFO interrupt
+typedef struct bus_isr_stats_s
+{
+  uint32_t runs;       // Interrupts
+  uint32_t events;     // Events passed to the device tasks
+  uint32_t wakeups;    // Batches (one per device task and burst)
+  uint32_t max_us;     // Longest interrupt
+} bus_isr_stats_t;
+
+static bus_isr_stats_t bus_isr_stats;
 
 // Free RTOS Stuff
 TaskHandle_t monitor_task_handle = NULL;
@@ -95,7 +120,15 @@ uint32_t ser_putc (uint8_t reg, uint8_t data)
  * Description:
  *   Interrupt handler for the FIFO that handles
  *   communication between Core 1 (Parbus) and
- *   Core 0 (Device implementation)
+ *   Core 0 (Device implementation). The FIFO only
+ *   serves as doorbell, the events are taken from the
+ *   bus ring, collected per device and passed to the
+ *   stream buffer of each device task in one go, so a
+ *   burst wakes each task once. When a stream buffer is
+ *   full, the remaining events stay in the ring until
+ *   the device task has taken its events. Events of more
+ *   than BUS_BATCHES devices are passed on in several
+ *   rounds.
  *
  * Input Parameters:
  *   None
@@ -109,27 +142,92 @@ void __not_in_flash_func(fifo_irq_handler)(void)
 {
   // Notify fifo input task that information is pending in FIFO
   BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  uint32_t t_start = time_us_32 ();
 
   // Note: If the FIFO is not emptied, the interrupt will
   // directly be activated again when the function leaves.
   // This will lead to an endless loop :-/
-  uint32_t fifo_rd;
-  uint8_t dev;
   while (sio_hw->fifo_st & 0x1)
-    {
-      fifo_rd = sio_hw->fifo_rd;
-      dev = (fifo_rd >> 12) & 0xF;
-
-      if (simdev[dev].queue != NULL)
-	xQueueSendFromISR (simdev[dev].queue,
-			   &fifo_rd,
-			   &xHigherPriorityTaskWoken);
-    }
+    (void) sio_hw->fifo_rd;
 
   // If error flags persist, clear them
   if (sio_hw->fifo_st & (0x8 + 0x4))
     sio_hw->fifo_st = 0;
 
+  uint32_t head = bus_ring.head,
+    tail = bus_ring.tail;
+  uint32_t event;
+  StreamBufferHandle_t events;
+  bus_batch *b;
+  unsigned int n_batches, i;
+  bool stalled = false;
+
+  if (head - tail > bus_ring.max_fill)
+    bus_ring.max_fill = head - tail;
+
+  while ((tail != head) && !stalled)
+    {
+      // Collect the events per device task
+      n_batches = 0;
+      while (tail != head)
+	{
+	  event = bus_ring.buf[tail & (BUS_RING_SIZE - 1)];
+	  events = io_route[(event >> 8) & 0xFF];
+
+	  if (events != NULL)
+	    {
+	      for (i = 0; (i < n_batches) && (batches[i].events != events); ++i)
+		;
+	      // All batches in use, pass them on first. The event
+	      // starts the next round.
+	      if (i == BUS_BATCHES)
+		break;
+
+	      b = &batches[i];
+	      if (i == n_batches)
+		{
+		  b->events = events;
+		  b->room = xStreamBufferSpacesAvailable (events) / PBUS_QUEUE_IS;
+		  b->n = 0;
+		  ++n_batches;
+		}
+
+	      // Stream buffer full, wait for the device task
+	      if (b->n == b->room)
+		{
+		  stalled = true;
+		  break;
+		}
+	      b->ev[b->n++] = event;
+	    }
+	  ++tail;
+	}
+
+      // Pass each batch with a single call
+      for (i = 0; i < n_batches; ++i)
+	if (batches[i].n > 0)
+	  {
+	    xStreamBufferSendFromISR (batches[i].events, batches[i].ev,
+				      batches[i].n * PBUS_QUEUE_IS,
+				      &xHigherPriorityTaskWoken);
+	    bus_isr_stats.events += batches[i].n;
+	    ++bus_isr_stats.wakeups;
+	  }
+
+      // Publish tail before reading head again. Either this check or
+      // the one in bus_event (parport.S) sees a new event.
+      bus_ring.tail = tail;
+      if (tail == head)
+	head = bus_ring.head;
+    }
+
+  if (stalled)
+    bus_ring_stall ();
+
+  ++bus_isr_stats.runs;
+  if (time_us_32 () - t_start > bus_isr_stats.max_us)
+    bus_isr_stats.max_us = time_us_32 () - t_start;
+
   portYIELD_FROM_ISR (xHigherPriorityTaskWoken);
 }
 
@@ -161,6 +259,365 @@ void dump_mem_area ()
   printf ("\n\n");
 }
 
+/****************************************************************************
+ * Name: dump_gdp_stats
+ *
+ * Description:
+ *   Prints the GDP performance counters to stdio and resets them. The
+ *   rates refer to the time since the last call.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void dump_gdp_stats ()
+{
+  static uint64_t t_last = 0;
+  uint64_t t_now = time_us_64 ();
+  uint32_t t_diff = (uint32_t) (t_now - t_last);
+  gdp_stats_t st = gdp_stats;
+
+  memset (&gdp_stats, 0, sizeof (gdp_stats));
+  t_last = t_now;
+
+  printf ("GDP statistics (%u ms)\n", (unsigned int) (t_diff / 1000));
+  printf ("Commands:   %u\n", (unsigned int) st.commands);
+  printf ("Vectors:    %u (%u/s)\n", (unsigned int) st.vectors,
+	  (unsigned int) ((uint64_t) st.vectors * 1000000 / t_diff));
+  printf ("List bytes: %u, lost %u (total)\n", (unsigned int) st.list_bytes,
+	  (unsigned int) gdp_list.lost);
+  printf ("Busy:       %u ms (EF9365: %u ms)\n", (unsigned int) (st.busy_us / 1000),
+	  (unsigned int) (st.model_us / 1000));
+  printf ("Beam waits: %u (%u ms)\n", (unsigned int) st.held,
+	  (unsigned int) (st.held_us / 1000));
+  printf ("Bus ring:   max %u of %u events, %u stalls, lost %u (total)\n",
+	  (unsigned int) bus_ring.max_fill, (unsigned int) BUS_RING_SIZE,
+	  (unsigned int) bus_ring.stalls, (unsigned int) bus_ring.lost);
+  printf ("Bus IRQ:    %u runs, %u events in %u wakeups, longest %u us (total)\n",
+	  (unsigned int) bus_isr_stats.runs, (unsigned int) bus_isr_stats.events,
+	  (unsigned int) bus_isr_stats.wakeups, (unsigned int) bus_isr_stats.max_us);
+  printf ("Core1:      %u words (total), longest slice %u cycles (%u ns)\n\n",
+	  (unsigned int) gdp_worker_stats.words,
+	  (unsigned int) gdp_worker_stats.max_cycles,
+	  (unsigned int) ((uint64_t) gdp_worker_stats.max_cycles * 1000000000 /
+			  clock_get_hz (clk_sys)));
+}
+
+/****************************************************************************
+ * Name: toggle_gdp_worker
+ *
+ * Description:
+ *   Switches the core1 render worker on or off and measures the
+ *   rectangle benchmark with the new setting. Shows the time core0
+ *   needs to issue the rectangles, the time until they are drawn and
+ *   the longest slice of core1 (which is the maximum additional delay
+ *   of a bus cycle).
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void toggle_gdp_worker ()
+{
+  uint32_t t_issue, t_done;
+
+  gdp_worker_enable (!gdp_worker_enabled);
+  gdp_worker_stats.max_cycles = 0;
+  gdp_worker_bench (&t_issue, &t_done);
+
+  printf ("Core1 worker: %s\n", gdp_worker_enabled ? "on" : "off");
+  printf ("Rectangles: issued %u us, drawn %u us\n", (unsigned int) t_issue,
+	  (unsigned int) t_done);
+  printf ("Longest slice: %u cycles (%u ns)\n\n",
+	  (unsigned int) gdp_worker_stats.max_cycles,
+	  (unsigned int) ((uint64_t) gdp_worker_stats.max_cycles * 1000000000 /
+			  clock_get_hz (clk_sys)));
+}
+
+/****************************************************************************
+ * Name: measure_bus_latency
+ *
+ * Description:
+ *   Measures for one second the longest time core1 needs to get back
+ *   to the bus loop, which is the worst case stretch of a bus cycle
+ *   (including the slices of the core1 worker, if enabled). Also shows
+ *   the highest use of the core1 stack since startup.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void measure_bus_latency ()
+{
+  uint32_t cycles;
+
+  bus_latency_start ();
+  vTaskDelay (1000 / portTICK_PERIOD_MS);
+  cycles = bus_latency_stop ();
+
+  printf ("Longest bus cycle service: %u cycles (%u ns)\n",
+	  (unsigned int) cycles,
+	  (unsigned int) ((uint64_t) cycles * 1000000000 / clock_get_hz (clk_sys)));
+  printf ("Core1 stack: %u of %u bytes used\n\n",
+	  (unsigned int) core1_stack_used (),
+	  (unsigned int) (CORE1_STACK_WORDS * 4));
+}
+
+/****************************************************************************
+ * Name: wait_percentile
+ *
+ * Description:
+ *   Determines a percentile of a WAIT histogram (upper end of the bin).
+ *
+ * Input Parameters:
+ *   hist   - Histogram (BUS_WAIT_BINS bins)
+ *   n      - Number of reads in the histogram
+ *   pct    - Percentile
+ *
+ * Returned Value:
+ *   Time in cycles
+ *
+ ****************************************************************************/
+
+static uint32_t wait_percentile (const uint32_t *hist, uint32_t n, uint32_t pct)
+{
+  uint32_t sum = 0;
+  unsigned int bin;
+
+  for (bin = 0; bin < BUS_WAIT_BINS - 1; ++bin)
+    {
+      sum += hist[bin];
+      if ((uint64_t) sum * 100 >= (uint64_t) n * pct)
+	break;
+    }
+  return ((1u << bin) - 1);
+}
+
+/****************************************************************************
+ * Name: measure_bus_wait
+ *
+ * Description:
+ *   Measures for one second how long reads wait for the firmware and
+ *   prints p50, p99 (upper end of the log2 bin) and the maximum for
+ *   each port that was read. The fixed part of WAIT given by the PIO
+ *   program is not included.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void measure_bus_wait ()
+{
+  uint32_t hz = clock_get_hz (clk_sys) / 1000;   // Cycles per ms
+
+  bus_wait_start ();
+  vTaskDelay (1000 / portTICK_PERIOD_MS);
+  bus_wait_stop ();
+
+  printf ("Port  Reads    p50 ns   p99 ns   max ns\n");
+  for (unsigned int port = 0; port < 256; ++port)
+    {
+      uint32_t n = 0;
+
+      for (unsigned int bin = 0; bin < BUS_WAIT_BINS; ++bin)
+	n += bus_wait.hist[port][bin];
+      if (n == 0)
+	continue;
+
+      printf (" %02x %8u %8u %8u %8u\n", port, (unsigned int) n,
+	      (unsigned int) ((uint64_t) wait_percentile (bus_wait.hist[port], n, 50) * 1000000 / hz),
+	      (unsigned int) ((uint64_t) wait_percentile (bus_wait.hist[port], n, 99) * 1000000 / hz),
+	      (unsigned int) ((uint64_t) bus_wait.max[port] * 1000000 / hz));
+    }
+  printf ("Writes %u, found FIFO full %u\n\n", (unsigned int) bus_wait.writes,
+	  (unsigned int) bus_wait.full);
+}
+
+/****************************************************************************
+ * Name: capture_bus
+ *
+ * Description:
+ *   Logic analyzer for the IO cycles. Asks for a trigger, records the
+ *   IO cycles (a quarter of the capture before the trigger) and sends
+ *   the capture to the host: A text line "TRACE <entries> <trigger
+ *   entry>" followed by 5 bytes per entry. These are the time since
+ *   the previous entry in us (16 bit, little endian, saturated), the
+ *   flags (bit 0: write, bit 1: read served by a handler, data not
+ *   recorded, bit 2: read of an unused port), A0-A7 and D0-D7.
+ *   ESC ends the capture early.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void capture_bus ()
+{
+  char line[16], *p = line;
+  unsigned int len = 0;
+  uint8_t ch = 0;
+  uint32_t mask = 0, value = 0;
+
+  printf ("Trigger ([R|W]port[=data] in hex, empty: none): ");
+  while ((ch != '\r') && (ch != '\n'))
+    if (xQueueReceive (stdio_dev.input_queue, &ch, portMAX_DELAY) &&
+	(ch >= ' ') && (len < sizeof (line) - 1))
+      {
+	line[len++] = ch;
+	putchar (ch);
+      }
+  line[len] = 0;
+  printf ("\n");
+
+  if ((*p == 'R') || (*p == 'r') || (*p == 'W') || (*p == 'w'))
+    {
+      mask |= BUS_TRACE_WRITE;
+      if ((*p == 'W') || (*p == 'w'))
+	value |= BUS_TRACE_WRITE;
+      ++p;
+    }
+  if (*p != 0)
+    {
+      mask |= 0xFF00;
+      value |= (strtoul (p, &p, 16) & 0xFF) << 8;
+    }
+  if (*p == '=')
+    {
+      mask |= 0xFF;
+      value |= strtoul (p + 1, &p, 16) & 0xFF;
+    }
+
+  printf ("Capturing, ESC to stop\n");
+  bus_trace_start (mask, value, BUS_TRACE_SIZE * 3 / 4);
+  while (bus_trace.active)
+    if (xQueueReceive (stdio_dev.input_queue, &ch, (TickType_t) 10) &&
+	(ch == 27))
+      break;
+  bus_trace_stop ();
+
+  uint32_t head = bus_trace.head,
+    n = (head < BUS_TRACE_SIZE) ? head : BUS_TRACE_SIZE,
+    first = head - n,
+    t_last = bus_trace.time[first & (BUS_TRACE_SIZE - 1)];
+
+  printf ("TRACE %u %d\n", (unsigned int) n,
+	  (bus_trace.trig == BUS_TRACE_NONE) ? -1 : (int) (bus_trace.trig - first));
+  for (uint32_t i = first; i != head; ++i)
+    {
+      uint32_t t = bus_trace.time[i & (BUS_TRACE_SIZE - 1)],
+	ev = bus_trace.event[i & (BUS_TRACE_SIZE - 1)],
+	dt = ((int32_t) (t - t_last) < 0) ? 0 : t - t_last;
+
+      if (dt > 0xFFFF)
+	dt = 0xFFFF;
+      putchar_raw (dt & 0xFF);
+      putchar_raw (dt >> 8);
+      putchar_raw (ev >> 16);
+      putchar_raw ((ev >> 8) & 0xFF);
+      putchar_raw (ev & 0xFF);
+      t_last = t;
+    }
+  printf ("\n");
+}
+
+/****************************************************************************
+ * Name: update_overlay
+ *
+ * Description:
+ *   Fills the on-screen monitor with the menu, the GDP counters (rates
+ *   since the previous update) and the CAS buffer state. The counters
+ *   are not reset, so the statistics function is not affected.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void update_overlay ()
+{
+  static uint64_t t_last = 0;
+  static gdp_stats_t st_last;
+  uint64_t t_now = time_us_64 ();
+  uint32_t t_diff = (uint32_t) (t_now - t_last) / 1000 + 1;   // ms
+  gdp_stats_t st = gdp_stats;
+
+  // Counters reset by the statistics function in the meantime
+  if ((st.commands < st_last.commands) || (st.vectors < st_last.vectors) ||
+      (st.list_bytes < st_last.list_bytes) || (st.busy_us < st_last.busy_us))
+    memset (&st_last, 0, sizeof (st_last));
+
+  ovl_print (0, "GDPico64 monitor                                  F12: close");
+  ovl_print (1, "C Reset CAS bufptr  V GDP speed  W Core1 worker  R Reset Z80");
+  ovl_print (3, "GDP  %6u cmd/s %7u vec/s %7u list B/s  busy %3u%%",
+	     (unsigned int) ((st.commands - st_last.commands) * 1000 / t_diff),
+	     (unsigned int) ((st.vectors - st_last.vectors) * 1000 / t_diff),
+	     (unsigned int) ((st.list_bytes - st_last.list_bytes) * 1000 / t_diff),
+	     (unsigned int) ((st.busy_us - st_last.busy_us) / 10 / t_diff));
+  ovl_print (4, "     speed %s, core1 worker %s, list lost %u",
+	     (gdp_speed == GDP_SPEED_TURBO) ? "turbo" : "authentic",
+	     gdp_worker_enabled ? "on" : "off", (unsigned int) gdp_list.lost);
+  ovl_print (5, "     beam waits %u, core1 longest slice %u cycles",
+	     (unsigned int) st.held, (unsigned int) gdp_worker_stats.max_cycles);
+  ovl_print (6, "CAS  buffer %u of %u bytes", (unsigned int) xmod_len,
+	     (unsigned int) sizeof (xmod_buffer));
+  ovl_print (7, "BUS  ring max %u of %u events, %u stalls, lost %u",
+	     (unsigned int) bus_ring.max_fill, (unsigned int) BUS_RING_SIZE,
+	     (unsigned int) bus_ring.stalls, (unsigned int) bus_ring.lost);
+  ovl_refresh ();
+
+  t_last = t_now;
+  st_last = st;
+}
+
+/****************************************************************************
+ * Name: toggle_gdp_speed
+ *
+ * Description:
+ *   Switches the GDP between authentic (EF9365) speed and full speed
+ *   and measures the reference trace with the new speed.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void toggle_gdp_speed ()
+{
+  uint32_t t_model, t_trace;
+
+  gdp_speed = (gdp_speed == GDP_SPEED_TURBO) ? GDP_SPEED_AUTHENTIC : GDP_SPEED_TURBO;
+  t_trace = gdp_time_trace (&t_model);
+
+  printf ("GDP speed: %s\n", (gdp_speed == GDP_SPEED_TURBO) ? "turbo" : "authentic");
+  printf ("Reference trace: %u us (EF9365: %u us)\n\n", (unsigned int) t_trace,
+	  (unsigned int) t_model);
+}
+
 /****************************************************************************
  * Name: reset_z80
  *
@@ -184,7 +641,7 @@ void reset_z80 ()
   pio_sm_set_enabled(pio, 1, false);
 
   gpio_put (RESET, true);
-  write_io_reg (0xF1, 0);
+  post_io_reg (0xF1, 0);
 
   pio_sm_restart(pio, 0);
   pio_sm_restart(pio, 1);
@@ -249,13 +706,6 @@ void task_monitor(void* unused_arg) {
   init_gdp ();
   printf ("gdp dev initialized\n");
 
-  // Setup simdev struct
-  memset (&simdev[0], 0, sizeof (iodev_list) * 16);
-  //  simdev[15].iodev_funct = ser_putc;
-  simdev[12].queue = cas_queue;
-  simdev[7].queue = gdp_queue;
-  simdev[6].queue = gdp_page_queue;
-
   // Clear Fifo
   uint32_t fifo_pop;
   while (multicore_fifo_pop_timeout_us(20,&fifo_pop))
@@ -280,6 +730,7 @@ void task_monitor(void* unused_arg) {
   // Now do the event loop
   int bTerm = 0;
   int renew = 1;
+  uint32_t t_overlay = 0;
   while (true) {
     if (renew)
       {
@@ -289,6 +740,14 @@ void task_monitor(void* unused_arg) {
 	printf ("T - Terminal mode\n");
 	printf ("I - Dump IO buffer\n");
 	printf ("C - Reset CAS bufptr\n");
+	printf ("P - GDP statistics\n");
+	printf ("G - GDP character self test\n");
+	printf ("V - Toggle GDP speed (authentic/turbo)\n");
+	printf ("W - Toggle GDP core1 worker\n");
+	printf ("L - Bus latency\n");
+	printf ("A - Bus capture (logic analyzer)\n");
+	printf ("H - Bus WAIT histograms\n");
+	printf ("M - XModem receive into memory window\n");
 	//	printf ("S - Start CAS output\n");
 	printf ("R - Reset Z80\n\n");
 	renew = 0;
@@ -306,7 +765,7 @@ void task_monitor(void* unused_arg) {
 	      }
 	    else
 	      {
-		write_io_reg (0x68, ch);
+		post_io_reg (0x68, ch);
 	      }
 	  }
 	else
@@ -336,6 +795,31 @@ void task_monitor(void* unused_arg) {
 		// Indicate character available to CAS interface
 		xmod_len = 0;
 		break;
+	      case 'p' :
+	      case 'P' : dump_gdp_stats ();
+		break;
+	      case 'g' :
+	      case 'G' :
+		printf ("Character self test: %d errors\n\n", test_char_paths ());
+		break;
+	      case 'v' :
+	      case 'V' : toggle_gdp_speed ();
+		break;
+	      case 'w' :
+	      case 'W' : toggle_gdp_worker ();
+		break;
+	      case 'l' :
+	      case 'L' : measure_bus_latency ();
+		break;
+	      case 'a' :
+	      case 'A' : capture_bus ();
+		break;
+	      case 'h' :
+	      case 'H' : measure_bus_wait ();
+		break;
+	      case 'm' :
+	      case 'M' : mem_load ();
+		break;
 	      case 'r' :
 	      case 'R' : reset_z80 ();
 		break;
@@ -347,8 +831,43 @@ void task_monitor(void* unused_arg) {
     // Temporary fix for PS/2 Keyboard
     if (xQueueReceive (ps2_dev.input_queue, &ch, (TickType_t) 0))
 	{
-	  write_io_reg (0x68, ch);
+	  if (ch == PS2_HOTKEY)
+	    {
+	      // Toggle on-screen monitor
+	      if (!ovl_visible)
+		update_overlay ();
+	      ovl_show (!ovl_visible);
+	    }
+	  else if (ovl_visible)
+	    {
+	      // Keys go to the on-screen monitor
+	      switch (ch)
+		{
+		case 'c' :
+		case 'C' : xmod_len = 0;
+		  break;
+		case 'v' :
+		case 'V' : toggle_gdp_speed ();
+		  break;
+		case 'w' :
+		case 'W' : toggle_gdp_worker ();
+		  break;
+		case 'r' :
+		case 'R' : reset_z80 ();
+		  break;
+		}
+	      update_overlay ();
+	    }
+	  else
+	    post_io_reg (0x68, ch);
 	}
+
+    // Refresh the on-screen monitor twice per second
+    if (ovl_visible && (time_us_32 () - t_overlay > 500000))
+      {
+	update_overlay ();
+	t_overlay = time_us_32 ();
+      }
   }
 }
 
@@ -24,35 +24,108 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "pico/multicore.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/timer.h"
+#include "hardware/dma.h"
+#include "hardware/pwm.h"
+#include "hardware/irq.h"
 
 #include "par_bus.h"
 #include "par_bus.pio.h"
 
-#include "gdp.h"
-#include "ps2key.h"
-#include "cas.h"
-#include "key.h"
-
-spin_lock_t io_spin_lock;
+#include "io_dev.h"
+#include <semphr.h>
 
 // Defined in:
 // parport.S
-extern void parloop (unsigned char *mem, uint32_t *regset);
-extern void ioregread (void);
-extern void ioregwrite (void);
-extern void noaction (void);
-extern void ser_sendflag (void);
+extern void parloop (unsigned char *mem, uint32_t *regset, void (* volatile *idle) (void),
+		     volatile uint32_t *rd_addr);
 
 
 // These are time critical and should be used exclusively for IO treatment
 // of the Z80 Parallel bus
 uint32_t __scratch_y(__STRING(z80_regset)) z80_regset[512];
 uint32_t *z80_regget = &z80_regset[256];
-uint8_t __scratch_y(__STRING(z80_mem)) z80_mem[256];
+uint8_t __scratch_y(__STRING(z80_mem)) __attribute__ ((aligned (512))) z80_mem[512];
+
+// DMA channels serving the reads of the Z80 (see init_read_dma)
+static uint dma_rd_channel_0, dma_rd_channel_1;
+
+// PIO addresses of the read modes (IO_RD_xxx) and of the wait for
+// posted writes
+static uint8_t rd_pc[3], rd_fence_pc;
+
+// Define a separate stack for core 1. Besides the pushes of the
+// handlers, parloop calls C functions: the idle hook (latency probe,
+// chained to the worker slice) and the read log (bus_log_write and
+// bus_log_reads with bus_trace_add/bus_wait_add), each a few frames
+// deep. It is filled with a pattern, so the depth actually used can be
+// checked (see core1_stack_used). Kept in main memory: scratch Y holds
+// the register bank and, at its top, the core0 stack used by the
+// interrupt handlers.
+#define CORE1_STACK_FILL 0xC0DEC0DE
+static uint32_t __attribute__ ((aligned (8))) core1_stack[CORE1_STACK_WORDS];
+
+// Function called by core1 while the bus is idle (NULL: none)
+void (* volatile core1_idle) (void) = NULL;
+
+// Register change posted by core0, applied by core1 while the bus
+// is idle. Kept in main memory, so polling it from core0 does not
+// compete with core1 for the scratch bank of the register bank.
+volatile uint32_t io_mailbox = 0;
+
+// Events from core1 to core0 (see bus_event in parport.S)
+bus_ring_t bus_ring;
+
+// Capture of IO cycles (see bus_trace_start)
+bus_trace_t bus_trace;
+
+// WAIT histograms (see bus_wait_start)
+bus_wait_t bus_wait;
+
+// PWM slice counting cycles for the WAIT measurement
+#define BUS_WAIT_PWM 7
+
+// Start of the read in progress, port | 0x100 of a read waiting for core1
+static uint32_t wait_start, wait_pending;
+
+// Reads are logged by two DMA channels chained behind the read DMA:
+// the address read by dma_rd_channel_1 and the time. Core1 moves
+// them into bus_trace or bus_wait (BUS_LOG_xxx, checked by parport.S).
+volatile uint32_t bus_log_mode = 0;
 
-// Define a separate stack for core 1
-uint32_t __scratch_y(__STRING(core1_stacj)) core1_stack[32];
+// Copy of bus_log_mode written by core1 in its idle path, acknowledges
+// the end of the log (see bus_log_stop)
+volatile uint32_t bus_log_ack = 0;
+
+// PWM counter | 0x10000 when core1 served a read during the WAIT
+// measurement (set by parport.S)
+volatile uint32_t bus_log_core1 = 0;
+
+#define BUS_LOG_BITS 6
+#define BUS_LOG_SIZE (1 << BUS_LOG_BITS)
+static uint dma_log_channel_adr, dma_log_channel_time;
+static uint32_t __attribute__ ((aligned (4 * BUS_LOG_SIZE))) bus_log_adr[BUS_LOG_SIZE];
+static uint32_t __attribute__ ((aligned (4 * BUS_LOG_SIZE))) bus_log_time[BUS_LOG_SIZE];
+static uint32_t bus_log_tail;
+
+// Draining of the bus ring waits for a device task
+static volatile bool bus_ring_stalled = false;
+
+// Set once core1 serves the bus (and the mailbox)
+static volatile bool io_bus_running = false;
+
+// Serializes the tasks posting to the mailbox (see change_io_reg)
+static StaticSemaphore_t io_mailbox_lock_buf;
+static SemaphoreHandle_t io_mailbox_lock;
+
+// Bus latency measurement (see bus_latency_start)
+static void (*lat_chain) (void);
+static uint32_t lat_last;
+static volatile uint32_t lat_max;
+static bool lat_primed;
 
 #define __dvi_func_x(f) __scratch_x(__STRING(f)) f
 
@@ -63,7 +136,8 @@ uint32_t __scratch_y(__STRING(core1_stacj)) core1_stack[32];
  * Description:
  *   Main function for core1. Waits for the "start signal" from core 0
  *   and calls the assembler code that waits for input on the PIO
- *   FIFOs and processes those inputs.
+ *   FIFOs and processes those inputs. The SysTick timer of core1 counts
+ *   processor cycles, so the idle hook can keep track of its time.
  *
  * Input Parameters:
  *   None
@@ -77,10 +151,696 @@ static void __dvi_func_x(core1_main)()
 {
   const char *s = (const char *) multicore_fifo_pop_blocking();
 
+  systick_hw->rvr = 0xFFFFFF;
+  systick_hw->cvr = 0;
+  systick_hw->csr = 0x5;   // Processor clock, no interrupt, enabled
+  io_bus_running = true;
+
   // The C code was not fast enough to get a proper bus timing.
   // Hence, a short assembler routine will watch for data requests
   // and provide them from z80_mem
-  parloop (z80_mem, z80_regset);
+  parloop (z80_mem, z80_regset, &core1_idle,
+	   &dma_hw->ch[dma_rd_channel_1].read_addr);
+}
+
+
+/****************************************************************************
+ * Name: change_io_reg
+ *
+ * Description:
+ *   Sets and clears bits of an IO register. The change is posted to
+ *   core1, which applies it between two bus cycles, so it cannot
+ *   interfere with a read-modify-write of core1 on the same register.
+ *   The bits in clear_bit are cleared first, then the bits in set_bit
+ *   are set, so clear_bit = 0xFF writes set_bit. Waits until the change
+ *   has been applied. Before core1 serves the bus, the register is
+ *   changed directly.
+ *
+ *   Must be called from a task. The tasks posting a change are
+ *   serialized by a mutex; the wait for core1 runs with interrupts
+ *   enabled, so it only delays the calling task.
+ *
+ * Input Parameters:
+ *   adr       - Address of the IO register
+ *   set_bit   - Bits to set
+ *   clear_bit - Bits to clear
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void change_io_reg (uint8_t adr, uint8_t set_bit, uint8_t clear_bit)
+{
+  if (!io_bus_running)
+    {
+      z80_mem[adr] = (z80_mem[adr] & ~clear_bit) | set_bit;
+      return;
+    }
+
+  xSemaphoreTake (io_mailbox_lock, portMAX_DELAY);
+  io_mailbox = 0x80000000u | (adr << 16) | (set_bit << 8) | clear_bit;
+  while (io_mailbox)
+    tight_loop_contents ();
+  xSemaphoreGive (io_mailbox_lock);
+}
+
+/****************************************************************************
+ * Name: post_io_reg
+ *
+ * Description:
+ *   Writes an IO register through core1 (see change_io_reg). Used for
+ *   registers that core1 also modifies.
+ *
+ * Input Parameters:
+ *   adr       - Address of the IO register
+ *   data      - New value
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void post_io_reg (uint8_t adr, uint8_t data)
+{
+  change_io_reg (adr, data, 0xFF);
+}
+
+/****************************************************************************
+ * Name: bus_ring_stall
+ *
+ * Description:
+ *   Called by the FIFO interrupt handler when it stops draining the bus
+ *   ring because a device queue is full. The remaining events stay in
+ *   the ring until the device task calls bus_ring_kick.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void bus_ring_stall ()
+{
+  bus_ring_stalled = true;
+  ++bus_ring.stalls;
+}
+
+/****************************************************************************
+ * Name: bus_ring_kick
+ *
+ * Description:
+ *   Called by a device task after it has taken an event from its queue.
+ *   When draining the bus ring has stopped, the FIFO interrupt is raised
+ *   to continue.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void bus_ring_kick ()
+{
+  if (bus_ring_stalled)
+    {
+      bus_ring_stalled = false;
+      irq_set_pending (SIO_IRQ_PROC0);
+    }
+}
+
+/****************************************************************************
+ * Name: bus_latency_probe
+ *
+ * Description:
+ *   Idle hook of core1 during the latency measurement. Keeps track of
+ *   the longest time between two visits of the idle path, which is the
+ *   longest time a bus cycle may have to wait for core1. The previous
+ *   idle hook is still called.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void __dvi_func_x(bus_latency_probe) (void)
+{
+  uint32_t now = systick_hw->cvr;
+
+  // SysTick counts down
+  if (lat_primed && (((lat_last - now) & 0xFFFFFF) > lat_max))
+    lat_max = (lat_last - now) & 0xFFFFFF;
+  lat_last = now;
+  lat_primed = true;
+
+  if (lat_chain)
+    lat_chain ();
+}
+
+/****************************************************************************
+ * Name: bus_latency_start
+ *
+ * Description:
+ *   Starts the measurement of the bus latency by installing the probe
+ *   as idle hook of core1.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void bus_latency_start ()
+{
+  lat_chain = core1_idle;
+  lat_primed = false;
+  lat_max = 0;
+  core1_idle = bus_latency_probe;
+}
+
+/****************************************************************************
+ * Name: bus_latency_stop
+ *
+ * Description:
+ *   Stops the measurement and restores the previous idle hook. The
+ *   idle hook must not be changed during the measurement.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   Longest time between two visits of the idle path in cycles
+ *
+ ****************************************************************************/
+
+uint32_t bus_latency_stop ()
+{
+  core1_idle = lat_chain;
+  return (lat_max);
+}
+
+
+/****************************************************************************
+ * Name: core1_stack_used
+ *
+ * Description:
+ *   Determines the highest use of the core1 stack since startup from
+ *   the words that still hold the fill pattern.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   Bytes of the stack that have been used
+ *
+ ****************************************************************************/
+
+uint32_t core1_stack_used ()
+{
+  unsigned int i;
+
+  for (i = 0; (i < CORE1_STACK_WORDS) && (core1_stack[i] == CORE1_STACK_FILL); ++i)
+    ;
+  return ((CORE1_STACK_WORDS - i) * 4);
+}
+
+/****************************************************************************
+ * Name: bus_trace_add
+ *
+ * Description:
+ *   Appends an IO cycle to the capture and checks the trigger. When
+ *   the requested number of entries after the trigger is recorded,
+ *   the capture ends.
+ *
+ * Input Parameters:
+ *   time   - Timer (us) of the cycle
+ *   event  - Flags | A0-A7 << 8 | D0-D7
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void __not_in_flash_func(bus_trace_add) (uint32_t time, uint32_t event)
+{
+  uint32_t n = bus_trace.head;
+
+  if (!bus_trace.active)
+    return;
+
+  if ((bus_trace.trig == BUS_TRACE_NONE) &&
+      ((event & bus_trace.trig_mask) == bus_trace.trig_value))
+    bus_trace.trig = n;
+
+  bus_trace.time[n & (BUS_TRACE_SIZE - 1)] = time;
+  bus_trace.event[n & (BUS_TRACE_SIZE - 1)] = event;
+  bus_trace.head = n + 1;
+
+  if ((bus_trace.trig != BUS_TRACE_NONE) &&
+      (n - bus_trace.trig >= bus_trace.post))
+    bus_trace.active = 0;
+}
+
+/****************************************************************************
+ * Name: bus_trace_read
+ *
+ * Description:
+ *   Records a read logged by DMA. The read DMA logs the address of the
+ *   read mode of the port and, for registers, the address of the
+ *   register. The value is taken from the register bank, which core1
+ *   has not changed since the read (registers written by core0
+ *   directly may differ).
+ *
+ * Input Parameters:
+ *   adr    - Address read by the read DMA
+ *   time   - Timer (us) of the transfer
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void __not_in_flash_func(bus_trace_read) (uint32_t adr, uint32_t time)
+{
+  uint8_t port = adr & 0xFF;
+
+  if ((adr & Z80_RDMODE) == 0)
+    bus_trace_add (time, (port << 8) | z80_mem[port]);
+  else if (z80_mem[Z80_RDMODE + port] == rd_pc[IO_RD_CORE1])
+    bus_trace_add (time, BUS_TRACE_HANDLER | (port << 8));
+  else if (z80_mem[Z80_RDMODE + port] == rd_pc[IO_RD_NONE])
+    bus_trace_add (time, BUS_TRACE_FLOAT | (port << 8) | 0xFF);
+  // Else followed by the read of the register
+}
+
+/****************************************************************************
+ * Name: bus_wait_add
+ *
+ * Description:
+ *   Adds the WAIT time of a read to the histogram of its port.
+ *
+ * Input Parameters:
+ *   port   - A0-A7
+ *   cycles - Time in cycles
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void __not_in_flash_func(bus_wait_add) (uint8_t port, uint32_t cycles)
+{
+  unsigned int bin = 0;
+
+  while (cycles >> bin)
+    ++bin;
+  if (bin >= BUS_WAIT_BINS)
+    bin = BUS_WAIT_BINS - 1;
+  ++bus_wait.hist[port][bin];
+  if (cycles > bus_wait.max[port])
+    bus_wait.max[port] = cycles;
+}
+
+/****************************************************************************
+ * Name: bus_wait_read
+ *
+ * Description:
+ *   Measures a read logged by DMA. The time runs from the lookup of the
+ *   read mode until the data is handed to the PIO: by the register
+ *   transfer of the read DMA or by core1 (bus_log_core1, set by
+ *   parport.S). This includes waiting for posted writes. Reads of
+ *   unused ports count as 0.
+ *
+ * Input Parameters:
+ *   adr    - Address read by the read DMA
+ *   time   - PWM counter (cycles) of the transfer
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void __not_in_flash_func(bus_wait_read) (uint32_t adr, uint32_t time)
+{
+  uint8_t port = adr & 0xFF;
+
+  if ((adr & Z80_RDMODE) == 0)
+    bus_wait_add (port, (time - wait_start) & 0xFFFF);
+  else
+    {
+      uint8_t mode = z80_mem[Z80_RDMODE + port];
+
+      wait_start = time;
+      if (mode == rd_pc[IO_RD_NONE])
+	bus_wait_add (port, 0);
+      else if (mode == rd_pc[IO_RD_CORE1])
+	wait_pending = port | 0x100;   // Completed when core1 has served the read
+    }
+}
+
+/****************************************************************************
+ * Name: bus_log_reads
+ *
+ * Description:
+ *   Called by core1 (parport.S) while the read log is chained, before
+ *   a write is processed and while the bus is idle. Moves the reads
+ *   logged by DMA into the capture or the WAIT histograms.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void __not_in_flash_func(bus_log_reads) ()
+{
+  uint32_t head = (dma_hw->ch[dma_log_channel_time].write_addr >> 2) &
+    (BUS_LOG_SIZE - 1);
+
+  // A read waiting for the posted writes follows them, so its lookup
+  // is left for later
+  if ((pio0_hw->sm[0].addr == rd_fence_pc) && (head != bus_log_tail) &&
+      (bus_log_adr[(head - 1) & (BUS_LOG_SIZE - 1)] & Z80_RDMODE))
+    head = (head - 1) & (BUS_LOG_SIZE - 1);
+
+  while (bus_log_tail != head)
+    {
+      uint32_t adr = bus_log_adr[bus_log_tail],
+	time = bus_log_time[bus_log_tail];
+
+      bus_log_tail = (bus_log_tail + 1) & (BUS_LOG_SIZE - 1);
+      if (bus_log_mode == BUS_LOG_TRACE)
+	bus_trace_read (adr, time);
+      else
+	bus_wait_read (adr, time);
+    }
+
+  // Read served by core1 since
+  if ((wait_pending != 0) && (bus_log_core1 != 0))
+    {
+      bus_wait_add (wait_pending & 0xFF, (bus_log_core1 - wait_start) & 0xFFFF);
+      wait_pending = 0;
+    }
+  bus_log_core1 = 0;
+}
+
+/****************************************************************************
+ * Name: bus_log_write
+ *
+ * Description:
+ *   Called by core1 (parport.S) for each write before it is processed,
+ *   while the read log is chained. Writes are posted, so the time of a
+ *   captured write is the time of processing, which may be slightly
+ *   later than the bus cycle. For the WAIT measurement, writes that
+ *   found the FIFO full (i.e. the next write held WAIT) are counted.
+ *
+ * Input Parameters:
+ *   event  - A0-A7 << 8 | D0-D7
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void __not_in_flash_func(bus_log_write) (uint32_t event)
+{
+  bus_log_reads ();
+  if (bus_log_mode == BUS_LOG_TRACE)
+    bus_trace_add (timer_hw->timerawl, BUS_TRACE_WRITE | event);
+  else
+    {
+      ++bus_wait.writes;
+      if (pio_sm_get_rx_fifo_level (pio0, 1) >= 7)
+	++bus_wait.full;
+    }
+}
+
+/****************************************************************************
+ * Name: bus_log_start
+ *
+ * Description:
+ *   Chains the log DMA channels behind the read DMA, which delays the
+ *   next read by two transfers.
+ *
+ * Input Parameters:
+ *   mode   - BUS_LOG_TRACE or BUS_LOG_WAIT
+ *   time   - Time source for the log
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void bus_log_start (uint32_t mode, volatile void *time)
+{
+  dma_channel_set_read_addr (dma_log_channel_time, time, false);
+  dma_channel_set_write_addr (dma_log_channel_adr, bus_log_adr, false);
+  dma_channel_set_write_addr (dma_log_channel_time, bus_log_time, false);
+  bus_log_tail = 0;
+  bus_log_core1 = 0;
+  __dmb ();
+  bus_log_mode = mode;
+
+  hw_write_masked (&dma_hw->ch[dma_rd_channel_1].al1_ctrl,
+		   dma_log_channel_adr << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB,
+		   DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS);
+}
+
+/****************************************************************************
+ * Name: bus_log_stop
+ *
+ * Description:
+ *   Unchains the log DMA channels and waits until core1 has seen the
+ *   log switched off in its idle path. Afterwards, core1 does not touch
+ *   the capture or the histograms any more.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void bus_log_stop ()
+{
+  hw_write_masked (&dma_hw->ch[dma_rd_channel_1].al1_ctrl,
+		   dma_rd_channel_0 << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB,
+		   DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS);
+  bus_log_ack = ~0u;
+  __dmb ();
+  bus_log_mode = 0;
+
+  // Let a running chain of the log channels finish
+  while (dma_channel_is_busy (dma_log_channel_adr) ||
+	 dma_channel_is_busy (dma_log_channel_time))
+    tight_loop_contents ();
+
+  // Core1 may still be in one of the log functions. It acknowledges
+  // the mode 0 only in its idle path, after it has left them.
+  if (io_bus_running)
+    while (bus_log_ack != 0)
+      tight_loop_contents ();
+}
+
+/****************************************************************************
+ * Name: bus_trace_start
+ *
+ * Description:
+ *   Starts a capture of all IO cycles. Entries are recorded into the
+ *   ring of bus_trace until post entries after the trigger are
+ *   recorded. Earlier entries remain as history before the trigger.
+ *
+ * Input Parameters:
+ *   trig_mask  - Bits of the event checked for the trigger (0: trigger
+ *                on the first cycle)
+ *   trig_value - Value of these bits
+ *   post       - Entries after the trigger (less than BUS_TRACE_SIZE)
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void bus_trace_start (uint32_t trig_mask, uint32_t trig_value, uint32_t post)
+{
+  bus_log_stop ();
+
+  bus_trace.trig_mask = trig_mask;
+  bus_trace.trig_value = trig_value & trig_mask;
+  bus_trace.post = post;
+  bus_trace.head = 0;
+  bus_trace.trig = BUS_TRACE_NONE;
+  bus_trace.active = 1;
+
+  bus_log_start (BUS_LOG_TRACE, &timer_hw->timerawl);
+}
+
+/****************************************************************************
+ * Name: bus_trace_stop
+ *
+ * Description:
+ *   Ends a capture.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void bus_trace_stop ()
+{
+  bus_log_stop ();
+  bus_trace.active = 0;
+}
+
+/****************************************************************************
+ * Name: bus_wait_start
+ *
+ * Description:
+ *   Clears the WAIT histograms and starts the measurement. A free
+ *   running PWM counter serves as cycle counter for the log.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void bus_wait_start ()
+{
+  pwm_config c = pwm_get_default_config ();
+
+  bus_log_stop ();
+  memset (&bus_wait, 0, sizeof (bus_wait));
+  wait_pending = 0;
+  pwm_init (BUS_WAIT_PWM, &c, true);
+
+  bus_log_start (BUS_LOG_WAIT, &pwm_hw->slice[BUS_WAIT_PWM].ctr);
+}
+
+/****************************************************************************
+ * Name: bus_wait_stop
+ *
+ * Description:
+ *   Ends the measurement, the histograms remain in bus_wait.
+ *
+ * Input Parameters:
+ *   None
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+void bus_wait_stop ()
+{
+  bus_log_stop ();
+  pwm_set_enabled (BUS_WAIT_PWM, false);
+}
+
+
+/****************************************************************************
+ * Name: init_read_dma
+ *
+ * Description:
+ *   Sets up the two DMA channels that serve the read cycles of the Z80
+ *   without core1, like the DMA/PIO driven LUT mapping of the GDP. The
+ *   state machine pushes the address of the read mode of a port and,
+ *   for plain registers, the address of the register. Channel 0 takes
+ *   each address and starts channel 1, which returns the byte at this
+ *   address to the state machine. For ports with a read handler, core1
+ *   finds the port in the read address of channel 1. During a capture
+ *   of IO cycles, channel 1 chains to the log channels, which then
+ *   start channel 0 (see bus_log_start).
+ *
+ * Input Parameters:
+ *   pio    - PIO in which the read statemachine resides
+ *   sm     - SM which handles the read cycles
+ *
+ * Returned Value:
+ *   None
+ *
+ ****************************************************************************/
+
+static void init_read_dma (PIO pio, uint sm)
+{
+  dma_rd_channel_0 = dma_claim_unused_channel (true);
+  dma_rd_channel_1 = dma_claim_unused_channel (true);
+
+  // Receive address from the PIO, start DMA channel 1
+  dma_channel_config c = dma_channel_get_default_config (dma_rd_channel_0);
+  channel_config_set_transfer_data_size (&c, DMA_SIZE_32);
+  channel_config_set_read_increment (&c, false);
+  channel_config_set_write_increment (&c, false);
+  channel_config_set_dreq (&c, pio_get_dreq (pio, sm, false));   // RX
+
+  dma_channel_configure (dma_rd_channel_0, &c,
+			 &dma_hw->ch[dma_rd_channel_1].al3_read_addr_trig,    // Destination pointer
+			 &pio->rxf[sm],    // Source pointer (PIO output)
+			 1,                // Halt after each transfer
+			 false);
+
+  // Transfer one byte from the address delivered by the PIO back
+  // to the PIO
+  c = dma_channel_get_default_config (dma_rd_channel_1);
+  channel_config_set_transfer_data_size (&c, DMA_SIZE_8);
+  channel_config_set_read_increment (&c, false);
+  channel_config_set_write_increment (&c, false);
+  channel_config_set_chain_to (&c, dma_rd_channel_0);
+  channel_config_set_dreq (&c, 0x3F);  // Unpace transfer
+
+  dma_channel_configure (dma_rd_channel_1, &c,
+			 &pio->txf[sm],    // Destination pointer (PIO input)
+			 z80_mem,          // Set by channel 0
+			 1,
+			 false);
+
+  // Log channels, copy the address read by channel 1 and the time
+  // into two rings
+  dma_log_channel_adr = dma_claim_unused_channel (true);
+  dma_log_channel_time = dma_claim_unused_channel (true);
+
+  c = dma_channel_get_default_config (dma_log_channel_adr);
+  channel_config_set_transfer_data_size (&c, DMA_SIZE_32);
+  channel_config_set_read_increment (&c, false);
+  channel_config_set_write_increment (&c, true);
+  channel_config_set_ring (&c, true, BUS_LOG_BITS + 2);
+  channel_config_set_chain_to (&c, dma_log_channel_time);
+  channel_config_set_dreq (&c, 0x3F);  // Unpace transfer
+
+  dma_channel_configure (dma_log_channel_adr, &c, bus_log_adr,
+			 &dma_hw->ch[dma_rd_channel_1].read_addr, 1, false);
+
+  c = dma_channel_get_default_config (dma_log_channel_time);
+  channel_config_set_transfer_data_size (&c, DMA_SIZE_32);
+  channel_config_set_read_increment (&c, false);
+  channel_config_set_write_increment (&c, true);
+  channel_config_set_ring (&c, true, BUS_LOG_BITS + 2);
+  channel_config_set_chain_to (&c, dma_rd_channel_0);
+  channel_config_set_dreq (&c, 0x3F);  // Unpace transfer
+
+  dma_channel_configure (dma_log_channel_time, &c, bus_log_time,
+			 &timer_hw->timerawl, 1, false);
+
+  // Base address of the register bank for the state machine
+  pio_sm_put (pio, sm, (uint32_t) z80_mem >> 9);
+  dma_channel_start (dma_rd_channel_0);
 }
 
 
@@ -110,62 +870,32 @@ int init_par_bus ()
   uint z80_tx1 = 0;
   uint z80_rx1 = 1;
   
-  // Clear Z80 memory
-  for (unsigned int i = 0; i < 256; ++i)
-    write_io_reg (i, 0);
-
   // Initialize PIO for parallel interface to Z80
   z80par_program_init(pio, z80_tx1, z80_rx1,
 		      offset_tx1, offset_rx1);
 
-  // New version, set hooks to small programs that carry out the
-  // required data modification
+  // Set hooks to small programs that carry out the required data
+  // modification, initial register values and the routing of events
+  // to the device tasks (see io_dev.c)
+  if (io_build (io_devices, io_n_devices, z80_regset, z80_regget, z80_mem,
+		io_route, io_stream) != 0)
+    printf ("IO device table has conflicts\n");
+
+  // The read modes become the addresses in the PIO program
+  rd_pc[IO_RD_NONE] = offset_tx1 + ndrnkc_tx1_offset_rd_none;
+  rd_pc[IO_RD_REG] = offset_tx1 + ndrnkc_tx1_offset_rd_reg;
+  rd_pc[IO_RD_CORE1] = offset_tx1 + ndrnkc_tx1_offset_rd_core1;
+  rd_fence_pc = offset_tx1 + ndrnkc_tx1_offset_rd_fence;
   for (unsigned int i = 0; i < 256; ++i)
-    {
-      // Default setup AND = 0xFF,  OR = 0x00, Affects same register
-      z80_regset[i] = (uint32_t) &noaction;
-      z80_regget[i] = 0;   // No data is put on bus!
-    }
+    z80_mem[Z80_RDMODE + i] = rd_pc[z80_mem[Z80_RDMODE + i]];
 
-  // Serial card
-  z80_regset[0xF0] = (uint32_t) &ser_sendflag;
-  z80_regset[0xF1] = (uint32_t) &ioregwrite;
-  z80_regget[0xF0] = (uint32_t) &ioregread;
-  z80_regget[0xF1] = (uint32_t) &ioregread;
-
-  // Page register
-  z80_regset[0x60] = (uint32_t) &gdp_setpages;
-  z80_regget[0x60] = (uint32_t) &ioregread;
-
-  // GDP64 register set
-  z80_regset[0x70] = (uint32_t) &gdp_sendcmd;
-  z80_regset[0x71] = (uint32_t) &ioregwrite;
-  z80_regset[0x72] = (uint32_t) &ioregwrite;
-  z80_regset[0x73] = (uint32_t) &ioregwrite;
-  z80_regset[0x75] = (uint32_t) &ioregwrite;
-  z80_regset[0x77] = (uint32_t) &ioregwrite;
-  z80_regset[0x78] = (uint32_t) &ioregwrite;
-  z80_regset[0x79] = (uint32_t) &ioregwrite;
-  z80_regset[0x7A] = (uint32_t) &ioregwrite;
-  z80_regset[0x7B] = (uint32_t) &ioregwrite;
-  for (unsigned int i = 0x70; i <= 0x7B; ++i)
-    z80_regget[i] = (uint32_t) &ioregread;
-
-  write_io_reg (0x70, 0xF4);  // Start with "non busy"
-
-  // Keyboard
-  //  z80_regset[0x68] = (uint32_t) &ioregwrite;
-  z80_regget[0x69] = (uint32_t) &key_setflag;
-  write_io_reg (0x68, 0x80);  // Start with "no key pending"
-  z80_regget[0x68] = (uint32_t) &ioregread;
-  
-  // CAS
-  //  z80_regset[0xCA] = (uint32_t) &ioregwrite;
-  z80_regget[0xCB] = (uint32_t) &cas_setflag;
-  z80_regset[0xCB] = (uint32_t) &cas_getflag;
-  write_io_reg (0xCA, 0x2);   // Start with "transmit buffer empty"
-  z80_regget[0xCA] = (uint32_t) &ioregread;
+  init_read_dma (pio, z80_tx1);
+
+  io_mailbox_lock = xSemaphoreCreateMutexStatic (&io_mailbox_lock_buf);
+
+  for (unsigned int i = 0; i < CORE1_STACK_WORDS; ++i)
+    core1_stack[i] = CORE1_STACK_FILL;
 
   //  multicore_launch_core1(core1_main);
-  multicore_launch_core1_with_stack(core1_main, core1_stack, 128);
+  multicore_launch_core1_with_stack(core1_main, core1_stack, sizeof (core1_stack));
 }
@@ -29,45 +29,167 @@
 #include "hardware/sync.h"
 #include "pico/stdlib.h"
 
-#define IO_SPIN_LOCK_NUM  2
-
-// For FreeRTOS Queue that receives results
-// from parallel bus via RP2040 interprocessor queue
+// Size of one bus event (A0-A7,D0-D7) in the stream buffers
+// of the device tasks
 #define PBUS_QUEUE_IS 4
 
-extern uint8_t z80_mem[256];
+// Number of events a device stream buffer holds and a device task
+// takes at once
+#define PBUS_EVENTS 32
+
+// Size of the ring of bus events passed to core0 (power of 2, must
+// match parport.S)
+#define BUS_RING_BITS 8
+#define BUS_RING_SIZE (1 << BUS_RING_BITS)
+
+// Bus events (A0-A7,D0-D7 of writes that need a device task) from core1
+// to core0. Written by core1 (head, lost) and core0 (tail, counters)
+// only. The intercore FIFO just signals that the ring became non-empty.
+typedef struct bus_ring_s
+{
+  volatile uint32_t head;     // Events written (core1)
+  volatile uint32_t tail;     // Events taken (core0)
+  volatile uint32_t lost;     // Events dropped on a full ring
+  uint32_t stalls;            // Draining stopped by a full device queue
+  uint32_t max_fill;          // Highest fill level seen by core0
+  uint32_t buf[BUS_RING_SIZE];
+} bus_ring_t;
+
+extern bus_ring_t bus_ring;
+
+// Size of the capture of IO cycles (power of 2)
+#define BUS_TRACE_BITS 11
+#define BUS_TRACE_SIZE (1 << BUS_TRACE_BITS)
+
+// Event of a captured IO cycle: flags | A0-A7 << 8 | D0-D7
+#define BUS_TRACE_WRITE   0x10000   // Write cycle (else read)
+#define BUS_TRACE_HANDLER 0x20000   // Read served by a handler, data not recorded
+#define BUS_TRACE_FLOAT   0x40000   // Read of an unused port, bus not driven
+
+// No trigger seen yet
+#define BUS_TRACE_NONE 0xFFFFFFFF
+
+// Capture of IO cycles (see bus_trace_start). Recording runs while
+// active is set, core1 clears it when the capture is complete.
+typedef struct bus_trace_s
+{
+  volatile uint32_t active;   // Checked by parport.S (offset 0)
+  uint32_t trig_mask;         // Trigger on (event & trig_mask) == trig_value
+  uint32_t trig_value;
+  uint32_t post;              // Entries recorded after the trigger
+  volatile uint32_t head;     // Entries recorded
+  volatile uint32_t trig;     // Entry of the trigger
+  uint32_t time[BUS_TRACE_SIZE];    // Timer (us)
+  uint32_t event[BUS_TRACE_SIZE];
+} bus_trace_t;
+
+extern bus_trace_t bus_trace;
+
+// WAIT histograms per port (see bus_wait_start). Bin n counts reads
+// of less than 2^n cycles (bin 0: no wait for firmware, last bin:
+// all longer ones).
+#define BUS_WAIT_BINS 16
+
+typedef struct bus_wait_s
+{
+  uint32_t hist[256][BUS_WAIT_BINS];
+  uint16_t max[256];          // Longest read per port (cycles)
+  uint32_t writes;            // Posted writes
+  uint32_t full;              // Writes that found the FIFO full
+} bus_wait_t;
+
+extern bus_wait_t bus_wait;
+
+// Use of the read log (checked by parport.S)
+#define BUS_LOG_TRACE 1
+#define BUS_LOG_WAIT  2
+
+// Register bank (0 - 255) followed by the read mode of each port
+// (Z80_RDMODE + port, see ndrnkc_tx1 in par_bus.pio)
+#define Z80_RDMODE 256
+extern uint8_t z80_mem[512];
+
+// Function called by core1 in short slices while the bus is idle
+extern void (* volatile core1_idle) (void);
+
+
+// Register change posted by core0 (0: empty, see change_io_reg)
+extern volatile uint32_t io_mailbox;
+
 
+/*
+ * The register bank is written by core1 only while it serves the bus.
+ * Single bytes are read and written atomically, so registers that are
+ * not modified by core1 itself are accessed directly. Registers that
+ * core1 changes in response to bus cycles (status flags) must be
+ * changed through change_io_reg or post_io_reg, which hand the change
+ * to core1.
+ */
 
 __force_inline static uint8_t read_io_reg (uint8_t adr)
 {
-  uint32_t save_irq;
-  uint8_t res = 0;
-  spin_lock_t *io_spin_lock = spin_lock_instance (IO_SPIN_LOCK_NUM);
-  save_irq = spin_lock_blocking (io_spin_lock);
-  res = z80_mem[adr];
-  spin_unlock (io_spin_lock, save_irq);
-  return (res);
+  return (((volatile uint8_t *) z80_mem)[adr]);
 }
 
 __force_inline static void write_io_reg (uint8_t adr, uint8_t data)
 {
-  uint32_t save_irq;
-  spin_lock_t *io_spin_lock = spin_lock_instance (IO_SPIN_LOCK_NUM);
-  save_irq = spin_lock_blocking (io_spin_lock);
-  z80_mem[adr] = data;
-  spin_unlock (io_spin_lock, save_irq);
+  ((volatile uint8_t *) z80_mem)[adr] = data;
 }
 
+void change_io_reg (uint8_t adr, uint8_t set_bit, uint8_t clear_bit);
 
-__force_inline static void change_io_reg (uint8_t adr, uint8_t set_bit, uint8_t clear_bit)
-{
-  uint32_t save_irq;
-  spin_lock_t *io_spin_lock = spin_lock_instance (IO_SPIN_LOCK_NUM);
-  save_irq = spin_lock_blocking (io_spin_lock);
-  z80_mem[adr] |= set_bit;
-  z80_mem[adr] &= ~clear_bit;
-  spin_unlock (io_spin_lock, save_irq);
-}
+void post_io_reg (uint8_t adr, uint8_t data);
+
+
+/*
+ * Draining the bus ring stops when a device queue is full (stall) and
+ * is restarted by the device task after it has taken an event from its
+ * queue (kick).
+ */
+
+void bus_ring_kick ();
+
+void bus_ring_stall ();
+
+
+/*
+ * Measures the longest time core1 needs to return to the bus loop
+ * (worst case delay of a bus cycle) between start and stop.
+ */
+
+void bus_latency_start ();
+
+uint32_t bus_latency_stop ();
+
+
+/*
+ * Stack of core1 (words) and the part of it used since startup (bytes).
+ */
+
+#define CORE1_STACK_WORDS 256
+
+uint32_t core1_stack_used ();
+
+
+/*
+ * Records all IO cycles into bus_trace until post entries after the
+ * trigger have been recorded (or until stopped). Not at the same time
+ * as the WAIT measurement.
+ */
+
+void bus_trace_start (uint32_t trig_mask, uint32_t trig_value, uint32_t post);
+
+void bus_trace_stop ();
+
+
+/*
+ * Measures the time reads wait for the firmware (posted writes, DMA,
+ * core1) into per port histograms between start and stop.
+ */
+
+void bus_wait_start ();
+
+void bus_wait_stop ();
 
 
 /*
@@ -52,10 +52,11 @@ CharDev ps2_dev;
 #define TAB 0x9
 #define LF 0xA
 #define ESC 0x1B
+#define F12 PS2_HOTKEY
 
 // Upper-Case ASCII codes by keyboard-code index, 16 elements per row
 static const uint8_t lower[] = {
-    0,  0,   0,   0,   0,   0,   0,   0,  0,  0,   0,   0,   0,   TAB, '`', 0,
+    0,  0,   0,   0,   0,   0,   0,   F12,0,  0,   0,   0,   0,   TAB, '`', 0,
     0,  0,   0,   0,   0,   'q', '1', 0,  0,  0,   'z', 's', 'a', 'w', '2', 0,
     0,  'c', 'x', 'd', 'e', '4', '3', 0,  0,  ' ', 'v', 'f', 't', 'r', '5', 0,
     0,  'n', 'b', 'h', 'g', 'y', '6', 0,  0,  0,   'm', 'j', 'u', '7', '8', 0,
@@ -66,7 +67,7 @@ static const uint8_t lower[] = {
 
 // Upper-Case ASCII codes by keyboard-code index
 static const uint8_t upper[] = {
-    0,  0,   0,   0,   0,   0,   0,   0,  0,  0,   0,   0,   0,   TAB, '~', 0,
+    0,  0,   0,   0,   0,   0,   0,   F12,0,  0,   0,   0,   0,   TAB, '~', 0,
     0,  0,   0,   0,   0,   'Q', '!', 0,  0,  0,   'Z', 'S', 'A', 'W', '@', 0,
     0,  'C', 'X', 'D', 'E', '$', '#', 0,  0,  ' ', 'V', 'F', 'T', 'R', '%', 0,
     0,  'N', 'B', 'H', 'G', 'Y', '^', 0,  0,  0,   'M', 'J', 'U', '&', '*', 0,
@@ -29,6 +29,9 @@
 
 #include "chardev.h"
 
+// Code delivered for F12 (not passed to the Z80, toggles the on-screen monitor)
+#define PS2_HOTKEY 0x80
+
 extern CharDev ps2_dev;
 
 extern void init_ps2key ();
@@ -42,6 +42,8 @@
 extern uint8_t xmod_buffer[4096];
 extern uint32_t xmod_len;
 
+extern int xmodemReceive (unsigned char *dest, int destsz);
+
 extern int xmodem_receive ();
 extern int xmodem_send ();
 